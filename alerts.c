@@ -25,7 +25,7 @@
 
 static int	alerts_fired;
 
-static void	alerts_timer(int, short, void *);
+static void	alerts_timer(void *);
 static int	alerts_enabled(struct window *, int);
 static void	alerts_callback(int, short, void *);
 static void	alerts_reset(struct window *);
@@ -36,12 +36,15 @@ static int	alerts_check_activity(struct window *);
 static int	alerts_check_silence(struct window *);
 static void printflike(2, 3) alerts_set_message(struct session *, const char *,
 		    ...);
+static void printflike(2, 3) alerts_set_client_message(struct client *,
+		    const char *, ...);
 static void	alerts_ring_bell(struct session *);
+static void	alerts_flush(void);
 
 static TAILQ_HEAD(, window) alerts_list = TAILQ_HEAD_INITIALIZER(alerts_list);
 
 static void
-alerts_timer(__unused int fd, __unused short events, void *arg)
+alerts_timer(void *arg)
 {
 	struct window	*w = arg;
 
@@ -66,9 +69,56 @@ alerts_callback(__unused int fd, __unused short events, __unused void *arg)
 		w->flags &= ~WINDOW_ALERTFLAGS;
 		window_remove_ref(w);
 	}
+	alerts_flush();
 	alerts_fired = 0;
 }
 
+/*
+ * Act on the alerts found by a batch of checks. Bells, messages and status
+ * line redraws are collected for each client while the windows are checked
+ * and done here, so each client gets at most one of each however many windows
+ * had alerts.
+ */
+static void
+alerts_flush(void)
+{
+	struct client	*c;
+	struct session	*s;
+
+	TAILQ_FOREACH(c, &clients, entry) {
+		if ((s = c->session) == NULL)
+			continue;
+
+		if (c->flags & CLIENT_ALERTBELL) {
+			c->flags &= ~CLIENT_ALERTBELL;
+			tty_putcode(&c->tty, TTYC_BEL);
+		}
+
+		if (c->alerts_message != NULL) {
+			status_message_set(c, "%s", c->alerts_message);
+			free(c->alerts_message);
+			c->alerts_message = NULL;
+		} else if (s->flags & SESSION_ALERTSTATUS)
+			server_status_client(c);
+	}
+
+	RB_FOREACH(s, sessions, &sessions)
+		s->flags &= ~(SESSION_ALERTED|SESSION_ALERTSTATUS);
+}
+
+/* Remove a window from the queue without checking it. */
+void
+alerts_dequeue(struct window *w)
+{
+	if (!w->alerts_queued)
+		return;
+	w->alerts_queued = 0;
+	TAILQ_REMOVE(&alerts_list, w, alerts_entry);
+
+	w->flags &= ~WINDOW_ALERTFLAGS;
+	window_remove_ref(w);
+}
+
 static int
 alerts_check_all(struct window *w)
 {
@@ -87,6 +137,7 @@ alerts_check_session(struct session *s)
 
 	RB_FOREACH(wl, winlinks, &s->windows)
 		alerts_check_all(wl->window);
+	alerts_flush();
 }
 
 static int
@@ -94,12 +145,13 @@ alerts_enabled(struct window *w, int flags)
 {
 	if (flags & WINDOW_BELL)
 		return (1);
+	window_update_options(w);
 	if (flags & WINDOW_ACTIVITY) {
-		if (options_get_number(w->options, "monitor-activity"))
+		if (w->monitor_activity)
 			return (1);
 	}
 	if (flags & WINDOW_SILENCE) {
-		if (options_get_number(w->options, "monitor-silence") != 0)
+		if (w->monitor_silence != 0)
 			return (1);
 	}
 	return (0);
@@ -120,14 +172,18 @@ alerts_reset(struct window *w)
 	struct timeval	tv;
 
 	w->flags &= ~WINDOW_SILENCE;
-	event_del(&w->alerts_timer);
+
+	if (!timer_initialized(&w->alerts_timer))
+		timer_set(&w->alerts_timer, alerts_timer, w);
 
 	timerclear(&tv);
 	tv.tv_sec = options_get_number(w->options, "monitor-silence");
 
 	log_debug("@%u alerts timer reset %u", w->id, (u_int)tv.tv_sec);
 	if (tv.tv_sec != 0)
-		event_add(&w->alerts_timer, &tv);
+		timer_add(&w->alerts_timer, &tv);
+	else
+		timer_del(&w->alerts_timer);
 }
 
 void
@@ -136,9 +192,6 @@ alerts_queue(struct window *w, int flags)
 	if (w->flags & WINDOW_ACTIVITY)
 		alerts_reset(w);
 
-	if (!event_initialized(&w->alerts_timer))
-		evtimer_set(&w->alerts_timer, alerts_timer, w);
-
 	if ((w->flags & flags) != flags) {
 		w->flags |= flags;
 		log_debug("@%u alerts flags added %#x", w->id, flags);
@@ -169,22 +222,16 @@ alerts_check_bell(struct window *w)
 	if (~w->flags & WINDOW_BELL)
 		return (0);
 
-	TAILQ_FOREACH(wl, &w->winlinks, wentry)
-		wl->session->flags &= ~SESSION_ALERTED;
-
 	TAILQ_FOREACH(wl, &w->winlinks, wentry) {
 		if (wl->flags & WINLINK_BELL)
 			continue;
 		s = wl->session;
 		if (s->curw != wl) {
 			wl->flags |= WINLINK_BELL;
+			s->flags |= SESSION_ALERTSTATUS;
 			notify_winlink("alert-bell", s, wl);
 		}
 
-		if (s->flags & SESSION_ALERTED)
-			continue;
-		s->flags |= SESSION_ALERTED;
-
 		action = options_get_number(s->options, "bell-action");
 		if (action == BELL_NONE)
 			return (0);
@@ -202,14 +249,15 @@ alerts_check_bell(struct window *w)
 
 			if (!visual) {
 				if (action != BELL_NONE)
-					tty_putcode(&c->tty, TTYC_BEL);
+					c->flags |= CLIENT_ALERTBELL;
 				continue;
 			}
-			if (action == BELL_CURRENT)
-				status_message_set(c, "Bell in current window");
-			else if (action != BELL_NONE) {
-				status_message_set(c, "Bell in window %d",
-				    wl->idx);
+			if (action == BELL_CURRENT) {
+				alerts_set_client_message(c,
+				    "Bell in current window");
+			} else if (action != BELL_NONE) {
+				alerts_set_client_message(c,
+				    "Bell in window %d", wl->idx);
 			}
 		}
 	}
@@ -228,9 +276,6 @@ alerts_check_activity(struct window *w)
 	if (!options_get_number(w->options, "monitor-activity"))
 		return (0);
 
-	TAILQ_FOREACH(wl, &w->winlinks, wentry)
-		wl->session->flags &= ~SESSION_ALERTED;
-
 	TAILQ_FOREACH(wl, &w->winlinks, wentry) {
 		if (wl->flags & WINLINK_ACTIVITY)
 			continue;
@@ -239,8 +284,10 @@ alerts_check_activity(struct window *w)
 			continue;
 
 		wl->flags |= WINLINK_ACTIVITY;
+		s->flags |= SESSION_ALERTSTATUS;
 		notify_winlink("alert-activity", s, wl);
 
+		/* Only the first alert in each session rings or shows. */
 		if (s->flags & SESSION_ALERTED)
 			continue;
 		s->flags |= SESSION_ALERTED;
@@ -265,9 +312,6 @@ alerts_check_silence(struct window *w)
 	if (!options_get_number(w->options, "monitor-silence"))
 		return (0);
 
-	TAILQ_FOREACH(wl, &w->winlinks, wentry)
-		wl->session->flags &= ~SESSION_ALERTED;
-
 	TAILQ_FOREACH(wl, &w->winlinks, wentry) {
 		if (wl->flags & WINLINK_SILENCE)
 			continue;
@@ -275,6 +319,7 @@ alerts_check_silence(struct window *w)
 		if (s->curw == wl)
 			continue;
 		wl->flags |= WINLINK_SILENCE;
+		s->flags |= SESSION_ALERTSTATUS;
 		notify_winlink("alert-silence", s, wl);
 
 		if (s->flags & SESSION_ALERTED)
@@ -291,6 +336,19 @@ alerts_check_silence(struct window *w)
 	return (WINDOW_SILENCE);
 }
 
+/* Set the message to show on a client when the alerts are flushed. */
+static void
+alerts_set_client_message(struct client *c, const char *fmt, ...)
+{
+	va_list	ap;
+
+	free(c->alerts_message);
+
+	va_start(ap, fmt);
+	xvasprintf(&c->alerts_message, fmt, ap);
+	va_end(ap);
+}
+
 static void
 alerts_set_message(struct session *s, const char *fmt, ...)
 {
@@ -304,7 +362,7 @@ alerts_set_message(struct session *s, const char *fmt, ...)
 
 	TAILQ_FOREACH(c, &clients, entry) {
 		if (c->session == s)
-			status_message_set(c, "%s", message);
+			alerts_set_client_message(c, "%s", message);
 	}
 
 	free(message);
@@ -317,6 +375,6 @@ alerts_ring_bell(struct session *s)
 
 	TAILQ_FOREACH(c, &clients, entry) {
 		if (c->session == s && !(c->flags & CLIENT_CONTROL))
-			tty_putcode(&c->tty, TTYC_BEL);
+			c->flags |= CLIENT_ALERTBELL;
 	}
 }
@@ -17,22 +17,98 @@
  */
 
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "tmux.h"
 
+/*
+ * Configuration files are read whole and split into lines in place, then each
+ * line is parsed once and the result kept in a cache keyed by the path, file
+ * identity, modification time and size. Sourcing an unchanged file again only
+ * walks the cached lines, evaluating any %if and queuing the parsed commands.
+ *
+ * A file modified in the current second could be changed again without its
+ * modification time changing (where it has no nanoseconds, or they are not
+ * updated), so it is not cached until it is older; nor is anything other than
+ * a regular file.
+ *
+ * Lines containing $ or ~ are expanded from the environment when they are
+ * parsed, and lines starting with an assignment (NAME=value) change the
+ * environment when they are parsed, so these are kept as text and parsed each
+ * time they are run, in order.
+ */
+
+#define CFG_CACHE_LIMIT 32
+
+enum cfg_type {
+	CFG_COMMAND,
+	CFG_PARSE,
+	CFG_IF,
+	CFG_ENDIF
+};
+
+struct cfg_line {
+	enum cfg_type	 type;
+	size_t		 line;
+
+	char		*string;
+	struct cmd_list	*cmdlist;
+};
+
+struct cfg_file {
+	char		*path;
+
+	dev_t		 dev;
+	ino_t		 ino;
+	time_t		 mtime;
+	long		 mtime_nsec;
+	off_t		 size;
+
+	struct cfg_line	*lines;
+	u_int		 nlines;
+	u_int		 linessize;
+
+	u_int		 used;
+
+	RB_ENTRY(cfg_file) entry;
+};
+RB_HEAD(cfg_files, cfg_file);
+
+static int	cfg_file_cmp(struct cfg_file *, struct cfg_file *);
+RB_GENERATE_STATIC(cfg_files, cfg_file, entry, cfg_file_cmp);
+
+static struct cfg_files	cfg_files = RB_INITIALIZER(&cfg_files);
+static u_int		cfg_nfiles;
+static u_int		cfg_used;
+
+static void		 cfg_free_file(struct cfg_file *);
+static long		 cfg_mtime_nsec(struct stat *);
+static char		*cfg_read(FILE *, size_t *);
+static void		 cfg_add_line(struct cfg_file *, char *, size_t);
+static struct cfg_file	*cfg_compile(const char *, struct stat *);
+static int		 cfg_run(struct cfg_file *, struct client *,
+			     struct cmdq_item *);
+
 char		 *cfg_file;
 int		  cfg_finished;
 static char	**cfg_causes;
 static u_int	  cfg_ncauses;
 struct client	 *cfg_client;
 
+static int
+cfg_file_cmp(struct cfg_file *cf1, struct cfg_file *cf2)
+{
+	return (strcmp(cf1->path, cf2->path));
+}
+
 static enum cmd_retval
 cfg_done(__unused struct cmdq_item *item, __unused void *data)
 {
@@ -77,78 +153,246 @@ start_cfg(void)
 	cmdq_append(cfg_client, cmdq_get_callback(cfg_done, NULL));
 }
 
-int
-load_cfg(const char *path, struct client *c, struct cmdq_item *item, int quiet)
+/* Free a cached file. */
+static void
+cfg_free_file(struct cfg_file *cf)
 {
-	FILE			*f;
-	const char		 delim[3] = { '\\', '\\', '\0' };
-	u_int			 found = 0;
-	size_t			 line = 0;
-	char			*buf, *cause1, *p, *q, *s;
-	struct cmd_list		*cmdlist;
-	struct cmdq_item	*new_item;
-	int			 condition = 0;
-	struct format_tree	*ft;
+	struct cfg_line	*cl;
+	u_int		 i;
+
+	for (i = 0; i < cf->nlines; i++) {
+		cl = &cf->lines[i];
+		free(cl->string);
+		if (cl->cmdlist != NULL)
+			cmd_list_free(cl->cmdlist);
+	}
+	free(cf->lines);
+	free(cf->path);
+	free(cf);
+}
 
-	log_debug("loading %s", path);
-	if ((f = fopen(path, "rb")) == NULL) {
-		if (errno == ENOENT && quiet)
-			return (0);
-		cfg_add_cause("%s: %s", path, strerror(errno));
-		return (-1);
+/* Get the nanoseconds of a modification time, if there are any. */
+static long
+cfg_mtime_nsec(struct stat *sb)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	return (sb->st_mtim.tv_nsec);
+#else
+	return (0);
+#endif
+}
+
+/* Read a whole file into a buffer with space for a terminating \0. */
+static char *
+cfg_read(FILE *f, size_t *len)
+{
+	char	*buf;
+	size_t	 size, n;
+
+	size = BUFSIZ;
+	buf = xmalloc(size);
+	*len = 0;
+	for (;;) {
+		n = fread(buf + *len, 1, size - *len - 1, f);
+		*len += n;
+		if (n == 0)
+			break;
+		if (*len == size - 1) {
+			buf = xreallocarray(buf, 2, size);
+			size *= 2;
+		}
+	}
+	if (ferror(f)) {
+		free(buf);
+		return (NULL);
 	}
+	buf[*len] = '\0';
+	return (buf);
+}
 
-	while ((buf = fparseln(f, NULL, &line, delim, 0)) != NULL) {
-		log_debug("%s: %s", path, buf);
+/* Parse a line and add it to a file. */
+static void
+cfg_add_line(struct cfg_file *cf, char *p, size_t line)
+{
+	struct cfg_line	*cl;
+	char		*q, *s;
+	size_t		 n;
 
-		p = buf;
-		while (isspace((u_char)*p))
-			p++;
-		if (*p == '\0') {
-			free(buf);
-			continue;
+	while (isspace((u_char)*p))
+		p++;
+	if (*p == '\0')
+		return;
+	q = p + strlen(p) - 1;
+	while (q != p && isspace((u_char)*q))
+		*q-- = '\0';
+
+	if (cf->nlines == cf->linessize) {
+		cf->linessize = cf->linessize == 0 ? 64 : cf->linessize * 2;
+		cf->lines = xreallocarray(cf->lines, cf->linessize,
+		    sizeof *cf->lines);
+	}
+	cl = &cf->lines[cf->nlines++];
+	memset(cl, 0, sizeof *cl);
+	cl->line = line;
+
+	if (strncmp(p, "%if ", 4) == 0) {
+		cl->type = CFG_IF;
+		s = p + 3;
+		while (isspace((u_char)*s))
+			s++;
+		cl->string = xstrdup(s);
+		return;
+	}
+	n = strcspn(p, " \t");
+	if (strcmp(p, "%endif") == 0)
+		cl->type = CFG_ENDIF;
+	else if (strpbrk(p, "$~") != NULL || memchr(p, '=', n) != NULL) {
+		cl->type = CFG_PARSE;
+		cl->string = xstrdup(p);
+		return;
+	} else
+		cl->type = CFG_COMMAND;
+
+	/*
+	 * An %endif outside an %if is parsed like any other line, so this is
+	 * kept for %endif as well.
+	 */
+	if (cmd_string_parse(p, &cl->cmdlist, cf->path, line, &s) != 0)
+		cl->string = s;
+}
+
+/* Read and parse a file. */
+static struct cfg_file *
+cfg_compile(const char *path, struct stat *sb)
+{
+	struct cfg_file	*cf;
+	FILE		*f;
+	char		*buf, *start, *out, *p, *end, *eol, *cp;
+	size_t		 len, line, n;
+	int		 cont;
+
+	if ((f = fopen(path, "rb")) == NULL)
+		return (NULL);
+	if (fstat(fileno(f), sb) != 0 || (buf = cfg_read(f, &len)) == NULL) {
+		fclose(f);
+		return (NULL);
+	}
+	fclose(f);
+
+	cf = xcalloc(1, sizeof *cf);
+	cf->path = xstrdup(path);
+	cf->dev = sb->st_dev;
+	cf->ino = sb->st_ino;
+	cf->mtime = sb->st_mtime;
+	cf->mtime_nsec = cfg_mtime_nsec(sb);
+	cf->size = sb->st_size;
+
+	/*
+	 * Split into lines in place, joining lines ending in an unescaped
+	 * backslash. Each joined line is copied down over the one before so
+	 * nothing needs to be allocated.
+	 */
+	p = buf;
+	end = buf + len;
+	line = 0;
+	while (p < end) {
+		start = out = p;
+		for (;;) {
+			line++;
+			if ((eol = memchr(p, '\n', end - p)) == NULL)
+				eol = end;
+			len = eol - p;
+
+			cont = 0;
+			if (len != 0 && p[len - 1] == '\\') {
+				n = 0;
+				for (cp = p + len - 1; cp != p; cp--) {
+					if (cp[-1] != '\\')
+						break;
+					n++;
+				}
+				if (n % 2 == 0) {
+					len--;
+					cont = 1;
+				}
+			}
+
+			memmove(out, p, len);
+			out += len;
+			p = (eol == end) ? end : eol + 1;
+
+			if (!cont)
+				break;
+			if (p == end) {
+				line++;
+				break;
+			}
 		}
-		q = p + strlen(p) - 1;
-		while (q != p && isspace((u_char)*q))
-			*q-- = '\0';
+		*out = '\0';
+		cfg_add_line(cf, start, line);
+	}
+	free(buf);
+
+	return (cf);
+}
 
-		if (condition != 0 && strcmp(p, "%endif") == 0) {
+/* Queue the commands from a file. */
+static int
+cfg_run(struct cfg_file *cf, struct client *c, struct cmdq_item *item)
+{
+	struct cfg_line		*cl;
+	struct cmd_list		*cmdlist;
+	struct cmdq_item	*new_item;
+	struct format_tree	*ft = NULL;
+	char			*cause, *s;
+	int			 condition = 0;
+	u_int			 i, found = 0;
+
+	for (i = 0; i < cf->nlines; i++) {
+		cl = &cf->lines[i];
+
+		if (condition != 0 && cl->type == CFG_ENDIF) {
 			condition = 0;
 			continue;
 		}
-		if (strncmp(p, "%if ", 4) == 0) {
+		if (cl->type == CFG_IF) {
 			if (condition != 0) {
-				cfg_add_cause("%s:%zu: nested %%if", path,
-				    line);
+				cfg_add_cause("%s:%zu: nested %%if", cf->path,
+				    cl->line);
 				continue;
 			}
-			ft = format_create(NULL, FORMAT_NOJOBS);
-
-			s = p + 3;
-			while (isspace((u_char)*s))
-				s++;
-			s = format_expand(ft, s);
+			if (ft == NULL)
+				ft = format_create(NULL, FORMAT_NOJOBS);
+			s = format_expand(ft, cl->string);
 			if (*s != '\0' && (s[0] != '0' || s[1] != '\0'))
 				condition = 1;
 			else
 				condition = -1;
 			free(s);
-
-			format_free(ft);
 			continue;
 		}
 		if (condition == -1)
 			continue;
 
-		if (cmd_string_parse(p, &cmdlist, path, line, &cause1) != 0) {
-			free(buf);
-			if (cause1 == NULL)
+		if (cl->type == CFG_PARSE) {
+			if (cmd_string_parse(cl->string, &cmdlist, cf->path,
+			    cl->line, &cause) != 0) {
+				if (cause == NULL)
+					continue;
+				cfg_add_cause("%s:%zu: %s", cf->path, cl->line,
+				    cause);
+				free(cause);
 				continue;
-			cfg_add_cause("%s:%zu: %s", path, line, cause1);
-			free(cause1);
-			continue;
+			}
+		} else {
+			if (cl->string != NULL) {
+				cfg_add_cause("%s:%zu: %s", cf->path, cl->line,
+				    cl->string);
+				continue;
+			}
+			if ((cmdlist = cl->cmdlist) != NULL)
+				cmdlist->references++;
 		}
-		free(buf);
 
 		if (cmdlist == NULL)
 			continue;
@@ -161,11 +405,75 @@ load_cfg(const char *path, struct client *c, struct cmdq_item *item, int quiet)
 
 		found++;
 	}
-	fclose(f);
+	if (ft != NULL)
+		format_free(ft);
 
 	return (found);
 }
 
+int
+load_cfg(const char *path, struct client *c, struct cmdq_item *item, int quiet)
+{
+	struct cfg_file		 find, *cf, *loop, *oldest;
+	struct stat		 sb;
+	int			 found;
+
+	log_debug("loading %s", path);
+	if (stat(path, &sb) != 0) {
+		if (errno == ENOENT && quiet)
+			return (0);
+		cfg_add_cause("%s: %s", path, strerror(errno));
+		return (-1);
+	}
+
+	find.path = (char *)path;
+	cf = RB_FIND(cfg_files, &cfg_files, &find);
+	if (cf != NULL &&
+	    (cf->dev != sb.st_dev ||
+	    cf->ino != sb.st_ino ||
+	    cf->mtime != sb.st_mtime ||
+	    cf->mtime_nsec != cfg_mtime_nsec(&sb) ||
+	    cf->size != sb.st_size)) {
+		log_debug("%s changed", path);
+		RB_REMOVE(cfg_files, &cfg_files, cf);
+		cfg_nfiles--;
+		cfg_free_file(cf);
+		cf = NULL;
+	}
+
+	if (cf == NULL) {
+		if ((cf = cfg_compile(path, &sb)) == NULL) {
+			cfg_add_cause("%s: %s", path, strerror(errno));
+			return (-1);
+		}
+		log_debug("%s has %u lines", path, cf->nlines);
+
+		if (!S_ISREG(sb.st_mode) || sb.st_mtime >= time(NULL)) {
+			log_debug("%s not cached", path);
+			found = cfg_run(cf, c, item);
+			cfg_free_file(cf);
+			return (found);
+		}
+
+		if (cfg_nfiles == CFG_CACHE_LIMIT) {
+			oldest = NULL;
+			RB_FOREACH(loop, cfg_files, &cfg_files) {
+				if (oldest == NULL || loop->used < oldest->used)
+					oldest = loop;
+			}
+			RB_REMOVE(cfg_files, &cfg_files, oldest);
+			cfg_nfiles--;
+			cfg_free_file(oldest);
+		}
+		RB_INSERT(cfg_files, &cfg_files, cf);
+		cfg_nfiles++;
+	} else
+		log_debug("%s cached (%u lines)", path, cf->nlines);
+	cf->used = ++cfg_used;
+
+	return (cfg_run(cf, c, item));
+}
+
 void
 cfg_add_cause(const char *fmt, ...)
 {
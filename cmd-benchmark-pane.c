@@ -0,0 +1,193 @@
+/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2016 Nicholas Marriott <nicholas.marriott@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <stdlib.h>
+
+#include "tmux.h"
+
+/*
+ * Replay files into a headless pane and report how long it took.
+ */
+
+static enum cmd_retval	cmd_benchmark_pane_exec(struct cmd *,
+			    struct cmdq_item *);
+
+static double	cmd_benchmark_pane_cpu(void);
+static int	cmd_benchmark_pane_run(struct cmdq_item *, const char *,
+		    const char *, size_t, const char *, u_int, u_int, u_int,
+		    u_int);
+
+const struct cmd_entry cmd_benchmark_pane_entry = {
+	.name = "benchmark-pane",
+	.alias = NULL,
+
+	.args = { "C:n:T:x:y:", 1, -1 },
+	.usage = "[-C clients] [-n count] [-T terminal] [-x width] "
+		 "[-y height] file ...",
+
+	.flags = 0,
+	.exec = cmd_benchmark_pane_exec
+};
+
+static enum cmd_retval
+cmd_benchmark_pane_exec(struct cmd *self, struct cmdq_item *item)
+{
+	struct args	*args = self->args;
+	struct client	*c = item->client;
+	const char	*term;
+	char		*cause, *buf;
+	u_int		 nclients, count, sx, sy;
+	size_t		 size;
+	int		 i;
+
+	nclients = 1;
+	if (args_has(args, 'C')) {
+		nclients = args_strtonum(args, 'C', 0, 1000, &cause);
+		if (cause != NULL) {
+			cmdq_error(item, "clients %s", cause);
+			free(cause);
+			return (CMD_RETURN_ERROR);
+		}
+	}
+	count = 1;
+	if (args_has(args, 'n')) {
+		count = args_strtonum(args, 'n', 1, INT_MAX, &cause);
+		if (cause != NULL) {
+			cmdq_error(item, "count %s", cause);
+			free(cause);
+			return (CMD_RETURN_ERROR);
+		}
+	}
+	sx = 80;
+	if (args_has(args, 'x')) {
+		sx = args_strtonum(args, 'x', PANE_MINIMUM, 10000, &cause);
+		if (cause != NULL) {
+			cmdq_error(item, "width %s", cause);
+			free(cause);
+			return (CMD_RETURN_ERROR);
+		}
+	}
+	sy = 24;
+	if (args_has(args, 'y')) {
+		sy = args_strtonum(args, 'y', PANE_MINIMUM, 10000, &cause);
+		if (cause != NULL) {
+			cmdq_error(item, "height %s", cause);
+			free(cause);
+			return (CMD_RETURN_ERROR);
+		}
+	}
+
+	if ((term = args_get(args, 'T')) == NULL) {
+		if (c != NULL && c->tty.term_name != NULL)
+			term = c->tty.term_name;
+		else
+			term = "xterm";
+	}
+
+	for (i = 0; i < args->argc; i++) {
+		buf = replay_read_file(c, args->argv[i], &size, &cause);
+		if (buf == NULL) {
+			cmdq_error(item, "%s", cause);
+			free(cause);
+			return (CMD_RETURN_ERROR);
+		}
+		if (cmd_benchmark_pane_run(item, args->argv[i], buf, size,
+		    term, nclients, count, sx, sy) != 0) {
+			free(buf);
+			return (CMD_RETURN_ERROR);
+		}
+		free(buf);
+	}
+
+	return (CMD_RETURN_NORMAL);
+}
+
+/* Get CPU time used so far in seconds. */
+static double
+cmd_benchmark_pane_cpu(void)
+{
+	struct rusage	ru;
+	struct timeval	tv;
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return (0);
+	timeradd(&ru.ru_utime, &ru.ru_stime, &tv);
+	return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+/*
+ * Replay a file. The input is first parsed with no clients attached, then
+ * again with the clients, and the difference is the time spent generating
+ * output for the clients. Finally each client is redrawn completely.
+ */
+static int
+cmd_benchmark_pane_run(struct cmdq_item *item, const char *name,
+    const char *buf, size_t size, const char *term, u_int nclients,
+    u_int count, u_int sx, u_int sy)
+{
+	struct replay		*r;
+	char			*cause;
+	double			 start, parse, total, redraw, mb;
+	unsigned long long	 allocs;
+	size_t			 written;
+	u_int			 i;
+
+	if ((r = replay_create(sx, sy, 0, term, &cause)) == NULL) {
+		cmdq_error(item, "%s", cause);
+		free(cause);
+		return (-1);
+	}
+	start = cmd_benchmark_pane_cpu();
+	for (i = 0; i < count; i++)
+		replay_input(r, buf, size);
+	parse = cmd_benchmark_pane_cpu() - start;
+	replay_free(r);
+
+	if ((r = replay_create(sx, sy, nclients, term, &cause)) == NULL) {
+		cmdq_error(item, "%s", cause);
+		free(cause);
+		return (-1);
+	}
+	allocs = xmalloc_count;
+	start = cmd_benchmark_pane_cpu();
+	for (i = 0; i < count; i++)
+		replay_input(r, buf, size);
+	total = cmd_benchmark_pane_cpu() - start;
+	allocs = xmalloc_count - allocs;
+
+	start = cmd_benchmark_pane_cpu();
+	replay_redraw(r);
+	redraw = cmd_benchmark_pane_cpu() - start;
+
+	written = 0;
+	if (nclients != 0)
+		written = replay_written(r, 0);
+	replay_free(r);
+
+	mb = (double)size * count / (1024 * 1024);
+	cmdq_print(item, "%s: bytes=%zu count=%u clients=%u size=%ux%u "
+	    "term=%s mbps=%.2f parse=%.3f tty=%.3f redraw=%.6f "
+	    "allocs=%llu output=%zu", name, size, count, nclients, sx, sy,
+	    term, total == 0 ? 0 : mb / total, parse,
+	    total > parse ? total - parse : 0, redraw, allocs, written);
+	return (0);
+}
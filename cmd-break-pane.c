@@ -82,7 +82,7 @@ cmd_break_pane_exec(struct cmd *self, struct cmdq_item *item)
 	window_set_name(w, name);
 	free(name);
 	layout_init(w, wp);
-	wp->flags |= PANE_CHANGED;
+	window_pane_dirty(wp, PANE_CHANGED);
 
 	if (idx == -1)
 		idx = -1 - options_get_number(dst_s->options, "base-index");
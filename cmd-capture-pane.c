@@ -18,6 +18,8 @@
 
 #include <sys/types.h>
 
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -25,23 +27,63 @@
 
 /*
  * Write the entire contents of a pane to a buffer or stdout.
+ *
+ * Output to stdout or a file is streamed a chunk of lines at a time from the
+ * event loop, so a large history does not have to be built up in memory and
+ * does not hold up the server. Reading from the pane is stopped until the
+ * capture is finished so the lines do not move.
  */
 
+/* Lines captured each time around the loop. */
+#define CAPTURE_PANE_LINES 1000
+
+/* Stop and wait if this many messages are waiting to go to the client. */
+#define CAPTURE_PANE_QUEUED 64
+
+struct cmd_capture_pane_data {
+	struct cmdq_item	*item;
+	struct client		*c;
+	FILE			*f;
+
+	u_int			 wp_id;
+	int			 alternate;
+
+	u_int			 line;
+	u_int			 bottom;
+
+	int			 with_codes;
+	int			 escape_c0;
+	int			 join_lines;
+	struct grid_cell	 lastgc;
+	struct grid_cell	*lastgcp;
+
+	char			*buf;
+	size_t			 len;
+	size_t			 size;
+};
+
 static enum cmd_retval	cmd_capture_pane_exec(struct cmd *, struct cmdq_item *);
 
 static char	*cmd_capture_pane_append(char *, size_t *, char *, size_t);
 static char	*cmd_capture_pane_pending(struct args *, struct window_pane *,
 		     size_t *);
+static int	 cmd_capture_pane_range(struct args *, struct cmdq_item *,
+		     struct window_pane *, struct grid **, u_int *, u_int *);
 static char	*cmd_capture_pane_history(struct args *, struct cmdq_item *,
 		     struct window_pane *, size_t *);
+static enum cmd_retval cmd_capture_pane_stream(struct args *,
+		     struct cmdq_item *, struct window_pane *);
+static int	 cmd_capture_pane_next(struct cmd_capture_pane_data *);
+static void	 cmd_capture_pane_callback(int, short, void *);
+static void	 cmd_capture_pane_free(struct cmd_capture_pane_data *);
 
 const struct cmd_entry cmd_capture_pane_entry = {
 	.name = "capture-pane",
 	.alias = "capturep",
 
-	.args = { "ab:CeE:JpPqS:t:", 0, 0 },
+	.args = { "ab:CeE:f:JpPqS:t:", 0, 0 },
 	.usage = "[-aCeJpPq] " CMD_BUFFER_USAGE " [-E end-line] "
-		 "[-S start-line]" CMD_TARGET_PANE_USAGE,
+		 "[-f target-file] [-S start-line] " CMD_TARGET_PANE_USAGE,
 
 	.tflag = CMD_PANE,
 
@@ -90,29 +132,24 @@ cmd_capture_pane_pending(struct args *args, struct window_pane *wp,
 	return (buf);
 }
 
-static char *
-
-cmd_capture_pane_history(struct args *args, struct cmdq_item *item,
-    struct window_pane *wp, size_t *len)
+/* Work out the grid and lines to capture. Returns -1 on error. */
+static int
+cmd_capture_pane_range(struct args *args, struct cmdq_item *item,
+    struct window_pane *wp, struct grid **gdp, u_int *topp, u_int *bottomp)
 {
-	struct grid		*gd;
-	const struct grid_line	*gl;
-	struct grid_cell	*gc = NULL;
-	int			 n, with_codes, escape_c0, join_lines;
-	u_int			 i, sx, top, bottom, tmp;
-	char			*cause, *buf, *line;
-	const char		*Sflag, *Eflag;
-	size_t			 linelen;
+	struct grid	*gd;
+	int		 n;
+	u_int		 top, bottom, tmp;
+	char		*cause;
+	const char	*Sflag, *Eflag;
 
-	sx = screen_size_x(&wp->base);
 	if (args_has(args, 'a')) {
 		gd = wp->saved_grid;
 		if (gd == NULL) {
-			if (!args_has(args, 'q')) {
+			if (!args_has(args, 'q'))
 				cmdq_error(item, "no alternate screen");
-				return (NULL);
-			}
-			return (xstrdup(""));
+			*gdp = NULL;
+			return (args_has(args, 'q') ? 0 : -1);
 		}
 	} else
 		gd = wp->base.grid;
@@ -155,6 +192,30 @@ cmd_capture_pane_history(struct args *args, struct cmdq_item *item,
 		top = tmp;
 	}
 
+	*gdp = gd;
+	*topp = top;
+	*bottomp = bottom;
+	return (0);
+}
+
+static char *
+cmd_capture_pane_history(struct args *args, struct cmdq_item *item,
+    struct window_pane *wp, size_t *len)
+{
+	struct grid		*gd;
+	const struct grid_line	*gl;
+	struct grid_cell	*gc = NULL;
+	int			 with_codes, escape_c0, join_lines;
+	u_int			 i, sx, top, bottom;
+	char			*buf, *line;
+	size_t			 linelen;
+
+	if (cmd_capture_pane_range(args, item, wp, &gd, &top, &bottom) != 0)
+		return (NULL);
+	if (gd == NULL)
+		return (xstrdup(""));
+	sx = screen_size_x(&wp->base);
+
 	with_codes = args_has(args, 'e');
 	escape_c0 = args_has(args, 'C');
 	join_lines = args_has(args, 'J');
@@ -176,6 +237,198 @@ cmd_capture_pane_history(struct args *args, struct cmdq_item *item,
 	return (buf);
 }
 
+/* Start streaming lines to stdout or a file. */
+static enum cmd_retval
+cmd_capture_pane_stream(struct args *args, struct cmdq_item *item,
+    struct window_pane *wp)
+{
+	struct cmd_capture_pane_data	*cdata;
+	struct client			*c = item->client;
+	struct session			*s;
+	struct grid			*gd;
+	u_int				 top, bottom;
+	int				 control, done;
+	const char			*path, *cwd;
+	char				*file;
+	FILE				*f = NULL;
+
+	if (cmd_capture_pane_range(args, item, wp, &gd, &top, &bottom) != 0)
+		return (CMD_RETURN_ERROR);
+	if (gd == NULL)
+		return (CMD_RETURN_NORMAL);
+
+	if ((path = args_get(args, 'f')) != NULL) {
+		if (c != NULL && c->session == NULL && c->cwd != NULL)
+			cwd = c->cwd;
+		else if (c != NULL && (s = c->session) != NULL &&
+		    s->cwd != NULL)
+			cwd = s->cwd;
+		else
+			cwd = ".";
+		if (*path == '/')
+			file = xstrdup(path);
+		else
+			xasprintf(&file, "%s/%s", cwd, path);
+		f = fopen(file, "wb");
+		if (f == NULL) {
+			cmdq_error(item, "%s: %s", file, strerror(errno));
+			free(file);
+			return (CMD_RETURN_ERROR);
+		}
+		free(file);
+	} else if (c == NULL ||
+	    (c->session != NULL && !(c->flags & CLIENT_CONTROL))) {
+		cmdq_error(item, "can't write to stdout");
+		return (CMD_RETURN_ERROR);
+	}
+
+	cdata = xcalloc(1, sizeof *cdata);
+	cdata->item = item;
+	cdata->f = f;
+	if (f == NULL) {
+		cdata->c = c;
+		c->references++;
+	}
+
+	cdata->wp_id = wp->id;
+	cdata->alternate = args_has(args, 'a');
+
+	cdata->line = top;
+	cdata->bottom = bottom;
+
+	cdata->with_codes = args_has(args, 'e');
+	cdata->escape_c0 = args_has(args, 'C');
+	cdata->join_lines = args_has(args, 'J');
+	memcpy(&cdata->lastgc, &grid_default_cell, sizeof cdata->lastgc);
+	cdata->lastgcp = &cdata->lastgc;
+
+	cdata->size = 8192;
+	cdata->buf = xmalloc(cdata->size);
+
+	/*
+	 * Control clients expect all the output before the end guard, so do
+	 * everything now.
+	 */
+	control = (cdata->c != NULL && (cdata->c->flags & CLIENT_CONTROL));
+	do
+		done = cmd_capture_pane_next(cdata);
+	while (!done && control);
+	if (done) {
+		cmd_capture_pane_free(cdata);
+		return (CMD_RETURN_NORMAL);
+	}
+
+	if (wp->captures++ == 0)
+		bufferevent_disable(wp->event, EV_READ);
+	event_once(-1, EV_TIMEOUT, cmd_capture_pane_callback, cdata, NULL);
+	return (CMD_RETURN_WAIT);
+}
+
+/* Capture the next chunk of lines. Returns 1 when finished. */
+static int
+cmd_capture_pane_next(struct cmd_capture_pane_data *cdata)
+{
+	struct client		*c = cdata->c;
+	struct window_pane	*wp;
+	struct grid		*gd;
+	const struct grid_line	*gl;
+	u_int			 end, sx;
+	char			*line;
+	size_t			 linelen;
+
+	if (c != NULL && (c->flags & CLIENT_DEAD))
+		return (1);
+	if ((wp = window_pane_find_by_id(cdata->wp_id)) == NULL)
+		return (1);
+	if (cdata->alternate)
+		gd = wp->saved_grid;
+	else
+		gd = wp->base.grid;
+	if (gd == NULL)
+		return (1);
+	sx = screen_size_x(&wp->base);
+
+	/* The pane may have been resized since the last chunk. */
+	if (cdata->bottom > gd->hsize + gd->sy - 1)
+		cdata->bottom = gd->hsize + gd->sy - 1;
+
+	end = cdata->line + CAPTURE_PANE_LINES;
+	cdata->len = 0;
+	for (; cdata->line <= cdata->bottom && cdata->line < end;
+	    cdata->line++) {
+		line = grid_string_cells(gd, 0, cdata->line, sx,
+		    &cdata->lastgcp, cdata->with_codes, cdata->escape_c0,
+		    !cdata->join_lines);
+		linelen = strlen(line);
+
+		while (cdata->len + linelen + 1 > cdata->size) {
+			cdata->buf = xreallocarray(cdata->buf, 2,
+			    cdata->size);
+			cdata->size *= 2;
+		}
+		memcpy(cdata->buf + cdata->len, line, linelen);
+		cdata->len += linelen;
+
+		gl = grid_peek_line(gd, cdata->line);
+		if (!cdata->join_lines || !(gl->flags & GRID_LINE_WRAPPED))
+			cdata->buf[cdata->len++] = '\n';
+
+		free(line);
+	}
+
+	if (cdata->f != NULL) {
+		if (fwrite(cdata->buf, 1, cdata->len, cdata->f) != cdata->len)
+			return (1);
+	} else {
+		evbuffer_add(c->stdout_data, cdata->buf, cdata->len);
+		server_client_push_stdout(c);
+	}
+	return (cdata->line > cdata->bottom);
+}
+
+/* Capture more lines, unless the client is still busy with the last. */
+static void
+cmd_capture_pane_callback(__unused int fd, __unused short events, void *arg)
+{
+	struct cmd_capture_pane_data	*cdata = arg;
+	struct client			*c = cdata->c;
+	struct window_pane		*wp;
+	struct timeval			 tv = { .tv_usec = 10000 };
+
+	if (c != NULL && (~c->flags & CLIENT_DEAD) &&
+	    (EVBUFFER_LENGTH(c->stdout_data) != 0 ||
+	    proc_queued(c->peer) > CAPTURE_PANE_QUEUED)) {
+		event_once(-1, EV_TIMEOUT, cmd_capture_pane_callback, cdata,
+		    &tv);
+		return;
+	}
+
+	if (!cmd_capture_pane_next(cdata)) {
+		event_once(-1, EV_TIMEOUT, cmd_capture_pane_callback, cdata,
+		    NULL);
+		return;
+	}
+
+	if ((wp = window_pane_find_by_id(cdata->wp_id)) != NULL &&
+	    --wp->captures == 0)
+		window_pane_read_resume(wp);
+
+	cdata->item->flags &= ~CMDQ_WAITING;
+	cmd_capture_pane_free(cdata);
+}
+
+/* Free streaming capture data. */
+static void
+cmd_capture_pane_free(struct cmd_capture_pane_data *cdata)
+{
+	if (cdata->f != NULL)
+		fclose(cdata->f);
+	if (cdata->c != NULL)
+		server_client_unref(cdata->c);
+	free(cdata->buf);
+	free(cdata);
+}
+
 static enum cmd_retval
 cmd_capture_pane_exec(struct cmd *self, struct cmdq_item *item)
 {
@@ -186,6 +439,10 @@ cmd_capture_pane_exec(struct cmd *self, struct cmdq_item *item)
 	const char		*bufname;
 	size_t			 len;
 
+	if (!args_has(args, 'P') &&
+	    (args_has(args, 'p') || args_has(args, 'f')))
+		return (cmd_capture_pane_stream(args, item, wp));
+
 	len = 0;
 	if (args_has(args, 'P'))
 		buf = cmd_capture_pane_pending(args, wp, &len);
@@ -59,10 +59,12 @@ cmd_kill_session_exec(struct cmd *self, struct cmdq_item *item)
 		server_redraw_session(s);
 	} else if (args_has(args, 'a')) {
 		RB_FOREACH_SAFE(sloop, sessions, &sessions, stmp) {
-			if (sloop != s) {
-				server_destroy_session(sloop);
-				session_destroy(sloop);
-			}
+			if (sloop == s)
+				continue;
+			server_destroy_session(sloop);
+			session_destroy(sloop);
+			if (cmdq_slice_expired())
+				return (CMD_RETURN_YIELD);
 		}
 	} else {
 		server_destroy_session(s);
@@ -69,8 +69,13 @@ cmd_kill_window_exec(struct cmd *self, struct cmdq_item *item)
 	} else {
 		if (args_has(args, 'a')) {
 			RB_FOREACH_SAFE(wl2, winlinks, &s->windows, wl3) {
-				if (wl != wl2)
-					server_kill_window(wl2->window);
+				if (wl == wl2)
+					continue;
+				server_kill_window(wl2->window);
+				if (cmdq_slice_expired()) {
+					recalculate_sizes();
+					return (CMD_RETURN_YIELD);
+				}
 			}
 		} else
 			server_kill_window(wl->window);
@@ -29,19 +29,21 @@
 #include "tmux.h"
 
 /*
- * Open pipe to redirect pane output. If already open, close first.
+ * Open pipe to redirect pane output, or write it straight to a file. If
+ * already open, close first.
  */
 
 static enum cmd_retval	cmd_pipe_pane_exec(struct cmd *, struct cmdq_item *);
 
+static void cmd_pipe_pane_write_callback(struct bufferevent *, void *);
 static void cmd_pipe_pane_error_callback(struct bufferevent *, short, void *);
 
 const struct cmd_entry cmd_pipe_pane_entry = {
 	.name = "pipe-pane",
 	.alias = "pipep",
 
-	.args = { "ot:", 0, 1 },
-	.usage = "[-o] " CMD_TARGET_PANE_USAGE " [command]",
+	.args = { "fot:", 0, 1 },
+	.usage = "[-fo] " CMD_TARGET_PANE_USAGE " [command]",
 
 	.tflag = CMD_PANE,
 
@@ -57,17 +59,15 @@ cmd_pipe_pane_exec(struct cmd *self, struct cmdq_item *item)
 	struct window_pane	*wp = item->state.tflag.wp;
 	struct session		*s = item->state.tflag.s;
 	struct winlink		*wl = item->state.tflag.wl;
-	char			*cmd;
+	struct session		*cs;
+	char			*cmd, *path;
+	const char		*cwd;
 	int			 old_fd, pipe_fd[2], null_fd;
 	struct format_tree	*ft;
 
 	/* Destroy the old pipe. */
 	old_fd = wp->pipe_fd;
-	if (wp->pipe_fd != -1) {
-		bufferevent_free(wp->pipe_event);
-		close(wp->pipe_fd);
-		wp->pipe_fd = -1;
-	}
+	window_pane_pipe_close(wp);
 
 	/* If no pipe command, that is enough. */
 	if (args->argc == 0 || *args->argv[0] == '\0')
@@ -82,18 +82,43 @@ cmd_pipe_pane_exec(struct cmd *self, struct cmdq_item *item)
 	if (args_has(self->args, 'o') && old_fd != -1)
 		return (CMD_RETURN_NORMAL);
 
-	/* Open the new pipe. */
-	if (socketpair(AF_UNIX, SOCK_STREAM, PF_UNSPEC, pipe_fd) != 0) {
-		cmdq_error(item, "socketpair error: %s", strerror(errno));
-		return (CMD_RETURN_ERROR);
-	}
-
 	/* Expand the command. */
 	ft = format_create(item, 0);
 	format_defaults(ft, c, s, wl, wp);
 	cmd = format_expand_time(ft, args->argv[0], time(NULL));
 	format_free(ft);
 
+	/* With -f, append to the file without starting a process. */
+	if (args_has(self->args, 'f')) {
+		if (c != NULL && c->session == NULL && c->cwd != NULL)
+			cwd = c->cwd;
+		else if (c != NULL && (cs = c->session) != NULL &&
+		    cs->cwd != NULL)
+			cwd = cs->cwd;
+		else
+			cwd = ".";
+		if (*cmd == '/')
+			path = xstrdup(cmd);
+		else
+			xasprintf(&path, "%s/%s", cwd, cmd);
+		free(cmd);
+
+		if (window_pane_pipe_file(wp, path) != 0) {
+			cmdq_error(item, "%s: %s", path, strerror(errno));
+			free(path);
+			return (CMD_RETURN_ERROR);
+		}
+		free(path);
+		return (CMD_RETURN_NORMAL);
+	}
+
+	/* Open the new pipe. */
+	if (socketpair(AF_UNIX, SOCK_STREAM, PF_UNSPEC, pipe_fd) != 0) {
+		cmdq_error(item, "socketpair error: %s", strerror(errno));
+		free(cmd);
+		return (CMD_RETURN_ERROR);
+	}
+
 	/* Fork the child. */
 	switch (fork()) {
 	case -1:
@@ -130,8 +155,9 @@ cmd_pipe_pane_exec(struct cmd *self, struct cmdq_item *item)
 		wp->pipe_fd = pipe_fd[0];
 		wp->pipe_off = EVBUFFER_LENGTH(wp->event->input);
 
-		wp->pipe_event = bufferevent_new(wp->pipe_fd,
-		    NULL, NULL, cmd_pipe_pane_error_callback, wp);
+		wp->pipe_event = bufferevent_new(wp->pipe_fd, NULL,
+		    cmd_pipe_pane_write_callback, cmd_pipe_pane_error_callback,
+		    wp);
 		bufferevent_enable(wp->pipe_event, EV_WRITE);
 
 		setblocking(wp->pipe_fd, 0);
@@ -141,13 +167,19 @@ cmd_pipe_pane_exec(struct cmd *self, struct cmdq_item *item)
 	}
 }
 
+static void
+cmd_pipe_pane_write_callback(__unused struct bufferevent *bufev, void *data)
+{
+	struct window_pane	*wp = data;
+
+	window_pane_pipe_unblock(wp);
+}
+
 static void
 cmd_pipe_pane_error_callback(__unused struct bufferevent *bufev,
     __unused short what, void *data)
 {
 	struct window_pane	*wp = data;
 
-	bufferevent_free(wp->pipe_event);
-	close(wp->pipe_fd);
-	wp->pipe_fd = -1;
+	window_pane_pipe_close(wp);
 }
@@ -17,6 +17,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/time.h>
 
 #include <ctype.h>
 #include <stdlib.h>
@@ -25,9 +26,18 @@
 
 #include "tmux.h"
 
+/*
+ * Time in microseconds the command queues may run for in each server loop
+ * before letting pane and client events be handled.
+ */
+#define CMDQ_SLICE 10000
+
 /* Global command queue. */
 static struct cmdq_list global_queue = TAILQ_HEAD_INITIALIZER(global_queue);
 
+/* End of current time slice. */
+static struct timeval cmdq_deadline;
+
 /* Get command queue name. */
 static const char *
 cmdq_name(struct client *c)
@@ -113,8 +123,7 @@ cmdq_remove(struct cmdq_item *item)
 
 	TAILQ_REMOVE(item->queue, item, entry);
 
-	free((void *)item->name);
-	free(item);
+	arena_free(item->arena);
 }
 
 /* Set command group. */
@@ -149,12 +158,15 @@ cmdq_get_command(struct cmd_list *cmdlist, struct cmd_find_state *current,
 	struct cmdq_item	*item, *first = NULL, *last = NULL;
 	struct cmd		*cmd;
 	u_int			 group = cmdq_next_group();
+	struct arena		*arena;
 	char			*tmp;
 
 	TAILQ_FOREACH(cmd, &cmdlist->list, qentry) {
-		xasprintf(&tmp, "command[%s]", cmd->entry->name);
+		arena = arena_create(sizeof *item + 128);
+		arena_asprintf(arena, &tmp, "command[%s]", cmd->entry->name);
 
-		item = xcalloc(1, sizeof *item);
+		item = arena_calloc(arena, 1, sizeof *item);
+		item->arena = arena;
 		item->name = tmp;
 		item->type = CMDQ_COMMAND;
 
@@ -179,6 +191,15 @@ cmdq_get_command(struct cmd_list *cmdlist, struct cmd_find_state *current,
 	return (first);
 }
 
+/* Is a state found before yielding still valid? An empty state is. */
+static int
+cmdq_valid_state(struct cmd_find_state *fs)
+{
+	if (fs->s == NULL)
+		return (1);
+	return (cmd_find_valid_state(fs));
+}
+
 /* Fire command on command queue. */
 static enum cmd_retval
 cmdq_fire_command(struct cmdq_item *item)
@@ -191,17 +212,33 @@ cmdq_fire_command(struct cmdq_item *item)
 	int			 flags;
 
 	flags = !!(cmd->flags & CMD_CONTROL);
-	cmdq_guard(item, "begin", flags);
-
-	if (cmd_prepare_state(cmd, item) != 0) {
+	if (~item->flags & CMDQ_YIELDED)
+		cmdq_guard(item, "begin", flags);
+
+	/*
+	 * A yielded command may already have changed what its targets refer to
+	 * (a relative target such as ! or +), so it keeps the state from when
+	 * it was first fired rather than finding them again.
+	 */
+	if (item->flags & CMDQ_YIELDED) {
+		if (!cmdq_valid_state(&item->state.tflag) ||
+		    !cmdq_valid_state(&item->state.sflag)) {
+			cmdq_error(item, "target no longer exists");
+			retval = CMD_RETURN_ERROR;
+			goto out;
+		}
+	} else if (cmd_prepare_state(cmd, item) != 0) {
 		retval = CMD_RETURN_ERROR;
 		goto out;
 	}
 	if (item->client == NULL)
 		item->client = cmd_find_client(item, NULL, CMD_FIND_QUIET);
 
+	/* Commands may look at the grid, so it must be reflowed first. */
+	window_pane_reflow_all();
+
 	retval = cmd->entry->exec(cmd, item);
-	if (retval == CMD_RETURN_ERROR)
+	if (retval == CMD_RETURN_ERROR || retval == CMD_RETURN_YIELD)
 		goto out;
 
 	if (cmd->entry->flags & CMD_AFTERHOOK) {
@@ -218,6 +255,8 @@ cmdq_fire_command(struct cmdq_item *item)
 
 out:
 	item->client = c;
+	if (retval == CMD_RETURN_YIELD)
+		return (retval);
 	if (retval == CMD_RETURN_ERROR)
 		cmdq_guard(item, "error", flags);
 	else
@@ -230,11 +269,14 @@ struct cmdq_item *
 cmdq_get_callback1(const char *name, cmdq_cb cb, void *data)
 {
 	struct cmdq_item	*item;
+	struct arena		*arena;
 	char			*tmp;
 
-	xasprintf(&tmp, "callback[%s]", name);
+	arena = arena_create(sizeof *item + 128);
+	arena_asprintf(arena, &tmp, "callback[%s]", name);
 
-	item = xcalloc(1, sizeof *item);
+	item = arena_calloc(arena, 1, sizeof *item);
+	item->arena = arena;
 	item->name = tmp;
 	item->type = CMDQ_CALLBACK;
 
@@ -263,7 +305,7 @@ cmdq_format(struct cmdq_item *item, const char *key, const char *fmt, ...)
 	char			*value;
 
 	va_start(ap, fmt);
-	xvasprintf(&value, fmt, ap);
+	arena_vasprintf(item->arena, &value, fmt, ap);
 	va_end(ap);
 
 	for (loop = item; loop != NULL; loop = item->next) {
@@ -271,8 +313,34 @@ cmdq_format(struct cmdq_item *item, const char *key, const char *fmt, ...)
 			loop->formats = format_create(NULL, 0);
 		format_add(loop->formats, key, "%s", value);
 	}
+}
 
-	free(value);
+/* Record how long an item took and log it if it was slow. */
+static void
+cmdq_time(struct cmdq_item *item, struct timeval *start)
+{
+	struct client		*c = item->client;
+	const char		*name;
+	char			*tmp;
+	unsigned long long	 us;
+
+	if (c == NULL)
+		name = "none";
+	else
+		name = server_client_name(c);
+
+	if (item->type == CMDQ_COMMAND) {
+		if ((us = stats_time(STATS_COMMAND, start)) == 0)
+			return;
+		tmp = cmd_print(item->cmd);
+		stats_slow(STATS_COMMAND, us, "%s (client %s)", tmp, name);
+		free(tmp);
+	} else {
+		if ((us = stats_time(STATS_CALLBACK, start)) == 0)
+			return;
+		stats_slow(STATS_CALLBACK, us, "%s (client %s)", item->name,
+		    name);
+	}
 }
 
 /* Process next item on command queue. */
@@ -283,8 +351,9 @@ cmdq_next(struct client *c)
 	const char		*name = cmdq_name(c);
 	struct cmdq_item	*item;
 	enum cmd_retval		 retval;
-	u_int			 items = 0;
+	u_int			 items = 0, fired = 0;
 	static u_int		 number;
+	struct timeval		 start;
 
 	if (TAILQ_EMPTY(queue)) {
 		log_debug("%s %s: empty", __func__, name);
@@ -311,14 +380,27 @@ cmdq_next(struct client *c)
 		if (item->flags & CMDQ_WAITING)
 			goto waiting;
 
+		/*
+		 * Stop if the time slice has run out, but always fire at least
+		 * one item so every queue makes progress.
+		 */
+		if (fired != 0 && cmdq_slice_expired())
+			goto yield;
+
 		/*
 		 * Items are only fired once, once the fired flag is set, a
-		 * waiting flag can only be cleared by an external event.
+		 * waiting flag can only be cleared by an external event. An
+		 * item that yields is fired again on the next loop.
 		 */
 		if (~item->flags & CMDQ_FIRED) {
-			item->time = time(NULL);
-			item->number = ++number;
+			if (~item->flags & CMDQ_YIELDED) {
+				item->time = time(NULL);
+				item->number = ++number;
+			}
+			trace_add(TRACE_CMDQ_FIRE, item->number, item->type,
+			    0);
 
+			gettimeofday(&start, NULL);
 			switch (item->type)
 			{
 			case CMDQ_COMMAND:
@@ -338,6 +420,14 @@ cmdq_next(struct client *c)
 				retval = CMD_RETURN_ERROR;
 				break;
 			}
+			trace_add(TRACE_CMDQ_DONE, item->number, retval, 0);
+			cmdq_time(item, &start);
+			fired++;
+
+			if (retval == CMD_RETURN_YIELD) {
+				item->flags |= CMDQ_YIELDED;
+				goto yield;
+			}
 			item->flags |= CMDQ_FIRED;
 
 			if (retval == CMD_RETURN_WAIT) {
@@ -355,6 +445,53 @@ cmdq_next(struct client *c)
 waiting:
 	log_debug("%s %s: exit (wait)", __func__, name);
 	return (items);
+
+yield:
+	log_debug("%s %s: exit (yield)", __func__, name);
+	return (items);
+}
+
+/* Start a new time slice. */
+void
+cmdq_slice_start(void)
+{
+	struct timeval	tv = { .tv_usec = CMDQ_SLICE };
+
+	gettimeofday(&cmdq_deadline, NULL);
+	timeradd(&cmdq_deadline, &tv, &cmdq_deadline);
+}
+
+/*
+ * Has the time slice run out? Long commands may check this and return
+ * CMD_RETURN_YIELD to be fired again on the next loop.
+ */
+int
+cmdq_slice_expired(void)
+{
+	struct timeval	tv;
+
+	gettimeofday(&tv, NULL);
+	return (timercmp(&tv, &cmdq_deadline, >));
+}
+
+/* Is there an item ready to fire on any queue? */
+int
+cmdq_ready(void)
+{
+	struct client		*c;
+	struct cmdq_item	*item;
+
+	item = TAILQ_FIRST(&global_queue);
+	if (item != NULL && (~item->flags & CMDQ_WAITING))
+		return (1);
+	TAILQ_FOREACH(c, &clients, entry) {
+		if (~c->flags & CLIENT_IDENTIFIED)
+			continue;
+		item = TAILQ_FIRST(&c->queue);
+		if (item != NULL && (~item->flags & CMDQ_WAITING))
+			return (1);
+	}
+	return (0);
 }
 
 /* Print a guard line. */
@@ -0,0 +1,140 @@
+/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2016 Nicholas Marriott <nicholas.marriott@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmux.h"
+
+/*
+ * Replay a file into a headless pane and show the resulting screen.
+ */
+
+static enum cmd_retval	cmd_replay_pane_exec(struct cmd *, struct cmdq_item *);
+
+const struct cmd_entry cmd_replay_pane_entry = {
+	.name = "replay-pane",
+	.alias = NULL,
+
+	.args = { "eo:pT:x:y:", 1, 1 },
+	.usage = "[-ep] [-o output-file] [-T terminal] [-x width] "
+		 "[-y height] file",
+
+	.flags = 0,
+	.exec = cmd_replay_pane_exec
+};
+
+static enum cmd_retval
+cmd_replay_pane_exec(struct cmd *self, struct cmdq_item *item)
+{
+	struct args		*args = self->args;
+	struct client		*c = item->client;
+	struct replay		*r;
+	struct window_pane	*wp;
+	struct screen		*s;
+	struct grid_cell	*gc;
+	const char		*term, *path;
+	char			*cause, *buf, *file, *line;
+	FILE			*f;
+	u_int			 sx, sy, y;
+	size_t			 size;
+
+	sx = 80;
+	if (args_has(args, 'x')) {
+		sx = args_strtonum(args, 'x', PANE_MINIMUM, 10000, &cause);
+		if (cause != NULL) {
+			cmdq_error(item, "width %s", cause);
+			free(cause);
+			return (CMD_RETURN_ERROR);
+		}
+	}
+	sy = 24;
+	if (args_has(args, 'y')) {
+		sy = args_strtonum(args, 'y', PANE_MINIMUM, 10000, &cause);
+		if (cause != NULL) {
+			cmdq_error(item, "height %s", cause);
+			free(cause);
+			return (CMD_RETURN_ERROR);
+		}
+	}
+
+	if ((term = args_get(args, 'T')) == NULL) {
+		if (c != NULL && c->tty.term_name != NULL)
+			term = c->tty.term_name;
+		else
+			term = "xterm";
+	}
+
+	path = args->argv[0];
+	buf = replay_read_file(c, path, &size, &cause);
+	if (buf == NULL) {
+		cmdq_error(item, "%s", cause);
+		free(cause);
+		return (CMD_RETURN_ERROR);
+	}
+
+	f = NULL;
+	if (args_has(args, 'o')) {
+		file = replay_get_path(c, args_get(args, 'o'));
+		if ((f = fopen(file, "wb")) == NULL) {
+			cmdq_error(item, "%s: %s", file, strerror(errno));
+			free(file);
+			free(buf);
+			return (CMD_RETURN_ERROR);
+		}
+		free(file);
+	}
+
+	if ((r = replay_create(sx, sy, 1, term, &cause)) == NULL) {
+		cmdq_error(item, "%s", cause);
+		free(cause);
+		if (f != NULL)
+			fclose(f);
+		free(buf);
+		return (CMD_RETURN_ERROR);
+	}
+	if (f != NULL)
+		replay_set_file(r, 0, f);
+	replay_input(r, buf, size);
+	free(buf);
+
+	wp = replay_pane(r);
+	s = wp->screen;
+	if (args_has(args, 'p')) {
+		gc = NULL;
+		for (y = 0; y < screen_size_y(s); y++) {
+			line = grid_string_cells(s->grid, 0, s->grid->hsize + y,
+			    screen_size_x(s), &gc, args_has(args, 'e'), 0, 1);
+			cmdq_print(item, "%s", line);
+			free(line);
+		}
+	}
+	cmdq_print(item, "%s: bytes=%zu size=%ux%u term=%s cursor=%u,%u "
+	    "history=%u output=%zu checksum=%08x", path, size, sx, sy, term,
+	    s->cx, s->cy, s->grid->hsize, replay_written(r, 0),
+	    replay_checksum(r));
+
+	replay_free(r);
+	if (f != NULL)
+		fclose(f);
+	return (CMD_RETURN_NORMAL);
+}
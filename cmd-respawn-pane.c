@@ -89,7 +89,7 @@ cmd_respawn_pane_exec(struct cmd *self, struct cmdq_item *item)
 		environ_free(env);
 		return (CMD_RETURN_ERROR);
 	}
-	wp->flags |= PANE_REDRAW;
+	window_pane_dirty(wp, PANE_REDRAW);
 	server_status_window(w);
 
 	environ_free(env);
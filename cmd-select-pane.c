@@ -114,7 +114,7 @@ cmd_select_pane_exec(struct cmd *self, struct cmdq_item *item)
 				cmdq_error(item, "bad style: %s", style);
 				return (CMD_RETURN_ERROR);
 			}
-			wp->flags |= PANE_REDRAW;
+			window_pane_dirty(wp, PANE_REDRAW);
 		}
 		if (args_has(self->args, 'g'))
 			cmdq_print(item, "%s", style_tostring(&wp->colgc));
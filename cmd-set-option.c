@@ -190,7 +190,7 @@ cmd_set_option_exec(struct cmd *self, struct cmdq_item *item)
 			if (w->active == NULL)
 				continue;
 			if (options_get_number(w->options, "automatic-rename"))
-				w->active->flags |= PANE_CHANGED;
+				window_pane_dirty(w->active, PANE_CHANGED);
 		}
 	}
 	if (strcmp(oe->name, "key-table") == 0) {
@@ -202,11 +202,6 @@ cmd_set_option_exec(struct cmd *self, struct cmdq_item *item)
 		status_timer_start_all();
 	if (strcmp(oe->name, "monitor-silence") == 0)
 		alerts_reset_all();
-	if (strcmp(oe->name, "window-style") == 0 ||
-	    strcmp(oe->name, "window-active-style") == 0) {
-		RB_FOREACH(w, windows, &windows)
-			w->flags |= WINDOW_STYLECHANGED;
-	}
 	if (strcmp(oe->name, "pane-border-status") == 0) {
 		RB_FOREACH(w, windows, &windows)
 			layout_fix_panes(w, w->sx, w->sy);
@@ -0,0 +1,101 @@
+/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2016 Nicholas Marriott <nicholas.marriott@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+
+#include <time.h>
+
+#include "tmux.h"
+
+/*
+ * Show server statistics.
+ */
+
+static enum cmd_retval	cmd_show_stats_exec(struct cmd *, struct cmdq_item *);
+
+const struct cmd_entry cmd_show_stats_entry = {
+	.name = "show-stats",
+	.alias = NULL,
+
+	.args = { "m", 0, 0 },
+	.usage = "[-m]",
+
+	.flags = CMD_AFTERHOOK,
+	.exec = cmd_show_stats_exec
+};
+
+static enum cmd_retval
+cmd_show_stats_exec(struct cmd *self, struct cmdq_item *item)
+{
+	struct args		*args = self->args;
+	struct window_pane	*wp;
+	struct client		*c;
+	struct stats_slow	*ss;
+	const char		*name;
+	char			 tim[64];
+	u_int			 i;
+	int			 machine = args_has(args, 'm');
+
+	for (i = 0; i < stats_count(); i++) {
+		if (machine) {
+			cmdq_print(item, "%s=%llu", stats_name(i),
+			    stats_value(i));
+		} else {
+			cmdq_print(item, "%-16s %llu", stats_name(i),
+			    stats_value(i));
+		}
+	}
+
+	RB_FOREACH(wp, window_pane_tree, &all_window_panes) {
+		if (machine) {
+			cmdq_print(item, "pane.%%%u.bytes_read=%llu", wp->id,
+			    wp->bytes_read);
+		} else {
+			cmdq_print(item, "%%%u: %llu bytes read", wp->id,
+			    wp->bytes_read);
+		}
+	}
+
+	TAILQ_FOREACH(c, &clients, entry) {
+		if (c->session == NULL)
+			continue;
+		name = server_client_name(c);
+		if (machine) {
+			cmdq_print(item, "client.%s.bytes_written=%llu", name,
+			    c->bytes_written);
+		} else {
+			cmdq_print(item, "%s: %llu bytes written", name,
+			    c->bytes_written);
+		}
+	}
+
+	TAILQ_FOREACH(ss, &stats_slow_list, entry) {
+		strftime(tim, sizeof tim, "%Y-%m-%d %H:%M:%S",
+		    localtime(&ss->time));
+		if (machine) {
+			cmdq_print(item, "slow=%lld %s %llu %s",
+			    (long long)ss->time, stats_type_name(ss->type),
+			    ss->us, ss->what);
+		} else {
+			cmdq_print(item, "%s: slow %s (%llu us): %s", tim,
+			    stats_type_name(ss->type), ss->us, ss->what);
+		}
+	}
+
+	return (CMD_RETURN_NORMAL);
+}
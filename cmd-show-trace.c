@@ -0,0 +1,89 @@
+/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2016 Nicholas Marriott <nicholas.marriott@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmux.h"
+
+/*
+ * Show or save the trace ring.
+ */
+
+static enum cmd_retval	cmd_show_trace_exec(struct cmd *, struct cmdq_item *);
+
+const struct cmd_entry cmd_show_trace_entry = {
+	.name = "show-trace",
+	.alias = NULL,
+
+	.args = { "o:", 0, 0 },
+	.usage = "[-o target-file]",
+
+	.flags = CMD_AFTERHOOK,
+	.exec = cmd_show_trace_exec
+};
+
+static enum cmd_retval
+cmd_show_trace_exec(struct cmd *self, struct cmdq_item *item)
+{
+	struct args	*args = self->args;
+	struct client	*c = item->client;
+	struct session	*s;
+	const char	*path, *cwd;
+	char		*file, **lines;
+	u_int		 i, n;
+
+	if ((path = args_get(args, 'o')) != NULL) {
+		if (c != NULL && c->session == NULL && c->cwd != NULL)
+			cwd = c->cwd;
+		else if (c != NULL && (s = c->session) != NULL &&
+		    s->cwd != NULL)
+			cwd = s->cwd;
+		else
+			cwd = ".";
+		if (*path == '/')
+			file = xstrdup(path);
+		else
+			xasprintf(&file, "%s/%s", cwd, path);
+		if (trace_save(file) != 0) {
+			cmdq_error(item, "%s: %s", file, strerror(errno));
+			free(file);
+			return (CMD_RETURN_ERROR);
+		}
+		free(file);
+		return (CMD_RETURN_NORMAL);
+	}
+
+	/*
+	 * Printing adds more entries to the ring, so describe them all
+	 * first.
+	 */
+	n = trace_count();
+	lines = xreallocarray(NULL, n, sizeof *lines);
+	for (i = 0; i < n; i++)
+		lines[i] = trace_describe(i);
+	for (i = 0; i < n; i++) {
+		cmdq_print(item, "%s", lines[i]);
+		free(lines[i]);
+	}
+	free(lines);
+	return (CMD_RETURN_NORMAL);
+}
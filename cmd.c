@@ -28,6 +28,7 @@
 #include "tmux.h"
 
 extern const struct cmd_entry cmd_attach_session_entry;
+extern const struct cmd_entry cmd_benchmark_pane_entry;
 extern const struct cmd_entry cmd_bind_key_entry;
 extern const struct cmd_entry cmd_break_pane_entry;
 extern const struct cmd_entry cmd_capture_pane_entry;
@@ -81,6 +82,7 @@ extern const struct cmd_entry cmd_previous_window_entry;
 extern const struct cmd_entry cmd_refresh_client_entry;
 extern const struct cmd_entry cmd_rename_session_entry;
 extern const struct cmd_entry cmd_rename_window_entry;
+extern const struct cmd_entry cmd_replay_pane_entry;
 extern const struct cmd_entry cmd_resize_pane_entry;
 extern const struct cmd_entry cmd_respawn_pane_entry;
 extern const struct cmd_entry cmd_respawn_window_entry;
@@ -103,6 +105,8 @@ extern const struct cmd_entry cmd_show_environment_entry;
 extern const struct cmd_entry cmd_show_hooks_entry;
 extern const struct cmd_entry cmd_show_messages_entry;
 extern const struct cmd_entry cmd_show_options_entry;
+extern const struct cmd_entry cmd_show_stats_entry;
+extern const struct cmd_entry cmd_show_trace_entry;
 extern const struct cmd_entry cmd_show_window_options_entry;
 extern const struct cmd_entry cmd_source_file_entry;
 extern const struct cmd_entry cmd_split_window_entry;
@@ -118,6 +122,7 @@ extern const struct cmd_entry cmd_wait_for_entry;
 
 const struct cmd_entry *cmd_table[] = {
 	&cmd_attach_session_entry,
+	&cmd_benchmark_pane_entry,
 	&cmd_bind_key_entry,
 	&cmd_break_pane_entry,
 	&cmd_capture_pane_entry,
@@ -170,6 +175,7 @@ const struct cmd_entry *cmd_table[] = {
 	&cmd_refresh_client_entry,
 	&cmd_rename_session_entry,
 	&cmd_rename_window_entry,
+	&cmd_replay_pane_entry,
 	&cmd_resize_pane_entry,
 	&cmd_respawn_pane_entry,
 	&cmd_respawn_window_entry,
@@ -192,6 +198,8 @@ const struct cmd_entry *cmd_table[] = {
 	&cmd_show_hooks_entry,
 	&cmd_show_messages_entry,
 	&cmd_show_options_entry,
+	&cmd_show_stats_entry,
+	&cmd_show_trace_entry,
 	&cmd_show_window_options_entry,
 	&cmd_source_file_entry,
 	&cmd_split_window_entry,
@@ -664,12 +672,20 @@ cmd_template_replace(const char *template, const char *s, int idx)
 	char		 ch, *buf;
 	const char	*ptr, *cp, quote[] = "\"\\$";
 	int		 replaced, quoted;
-	size_t		 len;
+	size_t		 len, size;
 
 	if (strchr(template, '%') == NULL)
 		return (xstrdup(template));
 
-	buf = xmalloc(1);
+	/*
+	 * Each replacement is at most three times the length of s, so work out
+	 * the largest the result can be and allocate it once.
+	 */
+	size = strlen(template) + 1;
+	for (ptr = template; (ptr = strchr(ptr, '%')) != NULL; ptr++)
+		size += strlen(s) * 3;
+
+	buf = xmalloc(size);
 	*buf = '\0';
 	len = 0;
 	replaced = 0;
@@ -689,7 +705,6 @@ cmd_template_replace(const char *template, const char *s, int idx)
 			if (quoted)
 				ptr++;
 
-			buf = xrealloc(buf, len + (strlen(s) * 3) + 1);
 			for (cp = s; *cp != '\0'; cp++) {
 				if (quoted && strchr(quote, *cp) != NULL)
 					buf[len++] = '\\';
@@ -702,7 +717,6 @@ cmd_template_replace(const char *template, const char *s, int idx)
 			buf[len] = '\0';
 			continue;
 		}
-		buf = xrealloc(buf, len + 2);
 		buf[len++] = ch;
 		buf[len] = '\0';
 	}
@@ -27,9 +27,14 @@
  * Environment - manipulate a set of environment variables.
  */
 
-RB_HEAD(environ, environ_entry);
+RB_HEAD(environ_tree, environ_entry);
 static int environ_cmp(struct environ_entry *, struct environ_entry *);
-RB_GENERATE_STATIC(environ, environ_entry, entry, environ_cmp);
+RB_GENERATE_STATIC(environ_tree, environ_entry, entry, environ_cmp);
+
+struct environ {
+	struct environ_tree	tree;
+	u_int			generation;	/* bumped on every change */
+};
 
 static int
 environ_cmp(struct environ_entry *envent1, struct environ_entry *envent2)
@@ -44,7 +49,7 @@ environ_create(void)
 	struct environ	*env;
 
 	env = xcalloc(1, sizeof *env);
-	RB_INIT(env);
+	RB_INIT(&env->tree);
 
 	return (env);
 }
@@ -55,8 +60,8 @@ environ_free(struct environ *env)
 {
 	struct environ_entry	*envent, *envent1;
 
-	RB_FOREACH_SAFE(envent, environ, env, envent1) {
-		RB_REMOVE(environ, env, envent);
+	RB_FOREACH_SAFE(envent, environ_tree, &env->tree, envent1) {
+		RB_REMOVE(environ_tree, &env->tree, envent);
 		free(envent->name);
 		free(envent->value);
 		free(envent);
@@ -67,13 +72,13 @@ environ_free(struct environ *env)
 struct environ_entry *
 environ_first(struct environ *env)
 {
-	return (RB_MIN(environ, env));
+	return (RB_MIN(environ_tree, &env->tree));
 }
 
 struct environ_entry *
 environ_next(struct environ_entry *envent)
 {
-	return (RB_NEXT(environ, env, envent));
+	return (RB_NEXT(environ_tree, env, envent));
 }
 
 /* Copy one environment into another. */
@@ -82,7 +87,7 @@ environ_copy(struct environ *srcenv, struct environ *dstenv)
 {
 	struct environ_entry	*envent;
 
-	RB_FOREACH(envent, environ, srcenv) {
+	RB_FOREACH(envent, environ_tree, &srcenv->tree) {
 		if (envent->value == NULL)
 			environ_clear(dstenv, envent->name);
 		else
@@ -97,7 +102,7 @@ environ_find(struct environ *env, const char *name)
 	struct environ_entry	envent;
 
 	envent.name = (char *) name;
-	return (RB_FIND(environ, env, &envent));
+	return (RB_FIND(environ_tree, &env->tree, &envent));
 }
 
 /* Set an environment variable. */
@@ -115,9 +120,10 @@ environ_set(struct environ *env, const char *name, const char *fmt, ...)
 		envent = xmalloc(sizeof *envent);
 		envent->name = xstrdup(name);
 		xvasprintf(&envent->value, fmt, ap);
-		RB_INSERT(environ, env, envent);
+		RB_INSERT(environ_tree, &env->tree, envent);
 	}
 	va_end(ap);
+	env->generation++;
 }
 
 /* Clear an environment variable. */
@@ -133,8 +139,9 @@ environ_clear(struct environ *env, const char *name)
 		envent = xmalloc(sizeof *envent);
 		envent->name = xstrdup(name);
 		envent->value = NULL;
-		RB_INSERT(environ, env, envent);
+		RB_INSERT(environ_tree, &env->tree, envent);
 	}
+	env->generation++;
 }
 
 /* Set an environment variable from a NAME=VALUE string. */
@@ -163,10 +170,11 @@ environ_unset(struct environ *env, const char *name)
 
 	if ((envent = environ_find(env, name)) == NULL)
 		return;
-	RB_REMOVE(environ, env, envent);
+	RB_REMOVE(environ_tree, &env->tree, envent);
 	free(envent->name);
 	free(envent->value);
 	free(envent);
+	env->generation++;
 }
 
 /*
@@ -197,19 +205,66 @@ environ_push(struct environ *env)
 	struct environ_entry	*envent;
 
 	environ = xcalloc(1, sizeof *environ);
-	RB_FOREACH(envent, environ, env) {
+	RB_FOREACH(envent, environ_tree, &env->tree) {
 		if (envent->value != NULL && *envent->name != '\0')
 			setenv(envent->name, envent->value, 1);
 	}
 }
 
+/* Return generation number, changed whenever the environment is modified. */
+u_int
+environ_generation(struct environ *env)
+{
+	return (env->generation);
+}
+
+/*
+ * Build a NULL-terminated array of NAME=VALUE strings suitable for execve(2),
+ * so the environment can be prepared before fork rather than in the child.
+ */
+char **
+environ_array(struct environ *env)
+{
+	struct environ_entry	 *envent;
+	char			**envp;
+	u_int			  n;
+
+	n = 0;
+	RB_FOREACH(envent, environ_tree, &env->tree) {
+		if (envent->value != NULL && *envent->name != '\0')
+			n++;
+	}
+
+	envp = xcalloc(n + 1, sizeof *envp);
+	n = 0;
+	RB_FOREACH(envent, environ_tree, &env->tree) {
+		if (envent->value != NULL && *envent->name != '\0') {
+			xasprintf(&envp[n++], "%s=%s", envent->name,
+			    envent->value);
+		}
+	}
+	envp[n] = NULL;
+	return (envp);
+}
+
+/* Free an array from environ_array(). */
+void
+environ_free_array(char **envp)
+{
+	char	**cp;
+
+	for (cp = envp; *cp != NULL; cp++)
+		free(*cp);
+	free(envp);
+}
+
 /* Log the environment. */
 void
 environ_log(struct environ *env, const char *prefix)
 {
 	struct environ_entry	*envent;
 
-	RB_FOREACH(envent, environ, env) {
+	RB_FOREACH(envent, environ_tree, &env->tree) {
 		if (envent->value != NULL && *envent->name != '\0') {
 			log_debug("%s%s=%s", prefix, envent->name,
 			    envent->value);
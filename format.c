@@ -67,6 +67,8 @@ static void	 format_cb_current_path(struct format_tree *,
 		     struct format_entry *);
 
 static char	*format_find(struct format_tree *, const char *, int);
+static struct format_entry *format_add_entry(struct format_tree *,
+		     const char *);
 static void	 format_add_cb(struct format_tree *, const char *, format_cb);
 static void	 format_add_tv(struct format_tree *, const char *,
 		     struct timeval *);
@@ -79,7 +81,11 @@ static void	 format_defaults_client(struct format_tree *, struct client *);
 static void	 format_defaults_winlink(struct format_tree *, struct session *,
 		     struct winlink *);
 
-/* Entry in format job tree. */
+/*
+ * Entry in format job tree. Jobs are shared between all clients and keyed by
+ * the expanded command, so the same command is only run once however many
+ * status lines use it.
+ */
 struct format_job {
 	const char		*cmd;
 	const char		*expanded;
@@ -103,7 +109,7 @@ RB_GENERATE_STATIC(format_job_tree, format_job, entry, format_job_cmp);
 static int
 format_job_cmp(struct format_job *fj1, struct format_job *fj2)
 {
-	return (strcmp(fj1->cmd, fj2->cmd));
+	return (strcmp(fj1->expanded, fj2->expanded));
 }
 
 /* Format modifiers. */
@@ -121,8 +127,14 @@ struct format_entry {
 	RB_ENTRY(format_entry)	 entry;
 };
 
-/* Format entry tree. */
+/*
+ * Format entry tree. The tree, its entries and their values are allocated
+ * from an arena and freed together.
+ */
 struct format_tree {
+	struct arena		*arena;
+	struct cmdq_item	*item;
+
 	struct window		*w;
 	struct session		*s;
 	struct window_pane	*wp;
@@ -240,30 +252,24 @@ format_job_get(struct format_tree *ft, const char *cmd)
 	struct format_job	 fj0, *fj;
 	time_t			 t;
 	char			*expanded;
-	int			 force;
 
-	fj0.cmd = cmd;
+	expanded = format_expand(ft, cmd);
+
+	fj0.expanded = expanded;
 	if ((fj = RB_FIND(format_job_tree, &format_jobs, &fj0)) == NULL) {
 		fj = xcalloc(1, sizeof *fj);
 		fj->cmd = xstrdup(cmd);
-		fj->expanded = NULL;
+		fj->expanded = expanded;
 
 		xasprintf(&fj->out, "<'%s' not ready>", fj->cmd);
 
 		RB_INSERT(format_job_tree, &format_jobs, fj);
-	}
-
-	expanded = format_expand(ft, cmd);
-	if (fj->expanded == NULL || strcmp(expanded, fj->expanded) != 0) {
-		free((void *)fj->expanded);
-		fj->expanded = xstrdup(expanded);
-		force = 1;
 	} else
-		force = (ft->flags & FORMAT_FORCE);
+		free(expanded);
 
 	t = time(NULL);
-	if (fj->job == NULL && (force || fj->last != t)) {
-		fj->job = job_run(expanded, NULL, NULL, format_job_callback,
+	if (fj->job == NULL && ((ft->flags & FORMAT_FORCE) || fj->last != t)) {
+		fj->job = job_run(fj->expanded, NULL, NULL, format_job_callback,
 		    NULL, fj);
 		if (fj->job == NULL) {
 			free(fj->out);
@@ -275,7 +281,6 @@ format_job_get(struct format_tree *ft, const char *cmd)
 	if (ft->flags & FORMAT_STATUS)
 		fj->status = 1;
 
-	free(expanded);
 	return (format_expand(ft, fj->out));
 }
 
@@ -311,36 +316,36 @@ format_job_timer(__unused int fd, __unused short events, __unused void *arg)
 
 /* Callback for host. */
 static void
-format_cb_host(__unused struct format_tree *ft, struct format_entry *fe)
+format_cb_host(struct format_tree *ft, struct format_entry *fe)
 {
 	char host[HOST_NAME_MAX + 1];
 
 	if (gethostname(host, sizeof host) != 0)
-		fe->value = xstrdup("");
+		fe->value = arena_strdup(ft->arena, "");
 	else
-		fe->value = xstrdup(host);
+		fe->value = arena_strdup(ft->arena, host);
 }
 
 /* Callback for host_short. */
 static void
-format_cb_host_short(__unused struct format_tree *ft, struct format_entry *fe)
+format_cb_host_short(struct format_tree *ft, struct format_entry *fe)
 {
 	char host[HOST_NAME_MAX + 1], *cp;
 
 	if (gethostname(host, sizeof host) != 0)
-		fe->value = xstrdup("");
+		fe->value = arena_strdup(ft->arena, "");
 	else {
 		if ((cp = strchr(host, '.')) != NULL)
 			*cp = '\0';
-		fe->value = xstrdup(host);
+		fe->value = arena_strdup(ft->arena, host);
 	}
 }
 
 /* Callback for pid. */
 static void
-format_cb_pid(__unused struct format_tree *ft, struct format_entry *fe)
+format_cb_pid(struct format_tree *ft, struct format_entry *fe)
 {
-	xasprintf(&fe->value, "%ld", (long)getpid());
+	arena_asprintf(ft->arena, &fe->value, "%ld", (long)getpid());
 }
 
 /* Callback for session_alerts. */
@@ -370,7 +375,7 @@ format_cb_session_alerts(struct format_tree *ft, struct format_entry *fe)
 		if (wl->flags & WINLINK_SILENCE)
 			strlcat(alerts, "~", sizeof alerts);
 	}
-	fe->value = xstrdup(alerts);
+	fe->value = arena_strdup(ft->arena, alerts);
 }
 
 /* Callback for window_layout. */
@@ -378,14 +383,19 @@ static void
 format_cb_window_layout(struct format_tree *ft, struct format_entry *fe)
 {
 	struct window	*w = ft->w;
+	char		*layout;
 
 	if (w == NULL)
 		return;
 
 	if (w->saved_layout_root != NULL)
-		fe->value = layout_dump(w->saved_layout_root);
+		layout = layout_dump(w->saved_layout_root);
 	else
-		fe->value = layout_dump(w->layout_root);
+		layout = layout_dump(w->layout_root);
+	if (layout != NULL) {
+		fe->value = arena_strdup(ft->arena, layout);
+		free(layout);
+	}
 }
 
 /* Callback for window_visible_layout. */
@@ -393,11 +403,15 @@ static void
 format_cb_window_visible_layout(struct format_tree *ft, struct format_entry *fe)
 {
 	struct window	*w = ft->w;
+	char		*layout;
 
 	if (w == NULL)
 		return;
 
-	fe->value = layout_dump(w->layout_root);
+	if ((layout = layout_dump(w->layout_root)) != NULL) {
+		fe->value = arena_strdup(ft->arena, layout);
+		free(layout);
+	}
 }
 
 /* Callback for pane_start_command. */
@@ -405,11 +419,14 @@ static void
 format_cb_start_command(struct format_tree *ft, struct format_entry *fe)
 {
 	struct window_pane	*wp = ft->wp;
+	char			*cmd;
 
 	if (wp == NULL)
 		return;
 
-	fe->value = cmd_stringify_argv(wp->argc, wp->argv);
+	cmd = cmd_stringify_argv(wp->argc, wp->argv);
+	fe->value = arena_strdup(ft->arena, cmd);
+	free(cmd);
 }
 
 /* Callback for pane_current_command. */
@@ -417,21 +434,25 @@ static void
 format_cb_current_command(struct format_tree *ft, struct format_entry *fe)
 {
 	struct window_pane	*wp = ft->wp;
-	char			*cmd;
+	const char		*name;
+	char			*cmd, *value;
 
 	if (wp == NULL)
 		return;
 
-	cmd = osdep_get_name(wp->fd, wp->tty);
-	if (cmd == NULL || *cmd == '\0') {
-		free(cmd);
+	name = window_pane_process_name(wp, ft->item != NULL);
+	if (name != NULL && *name != '\0')
+		cmd = xstrdup(name);
+	else {
 		cmd = cmd_stringify_argv(wp->argc, wp->argv);
 		if (cmd == NULL || *cmd == '\0') {
 			free(cmd);
 			cmd = xstrdup(wp->shell);
 		}
 	}
-	fe->value = parse_window_name(cmd);
+	value = parse_window_name(cmd);
+	fe->value = arena_strdup(ft->arena, value);
+	free(value);
 	free(cmd);
 }
 
@@ -440,14 +461,14 @@ void
 format_cb_current_path(struct format_tree *ft, struct format_entry *fe)
 {
 	struct window_pane	*wp = ft->wp;
-	char			*cwd;
+	const char		*cwd;
 
 	if (wp == NULL)
 		return;
 
-	cwd = osdep_get_cwd(wp->fd);
+	cwd = window_pane_process_cwd(wp, ft->item != NULL);
 	if (cwd != NULL)
-		fe->value = xstrdup(cwd);
+		fe->value = arena_strdup(ft->arena, cwd);
 }
 
 /* Callback for history_bytes. */
@@ -472,7 +493,7 @@ format_cb_history_bytes(struct format_tree *ft, struct format_entry *fe)
 	}
 	size += gd->hsize * sizeof *gd->linedata;
 
-	xasprintf(&fe->value, "%llu", size);
+	arena_asprintf(ft->arena, &fe->value, "%llu", size);
 }
 
 /* Callback for pane_tabs. */
@@ -497,7 +518,8 @@ format_cb_pane_tabs(struct format_tree *ft, struct format_entry *fe)
 		evbuffer_add_printf(buffer, "%u", i);
 	}
 	size = EVBUFFER_LENGTH(buffer);
-	xasprintf(&fe->value, "%.*s", size, EVBUFFER_DATA(buffer));
+	arena_asprintf(ft->arena, &fe->value, "%.*s", size,
+	    EVBUFFER_DATA(buffer));
 	evbuffer_free(buffer);
 }
 
@@ -519,13 +541,17 @@ struct format_tree *
 format_create(struct cmdq_item *item, int flags)
 {
 	struct format_tree	*ft;
+	struct arena		*arena;
 
 	if (!event_initialized(&format_job_event)) {
 		evtimer_set(&format_job_event, format_job_timer, NULL);
 		format_job_timer(-1, 0, NULL);
 	}
 
-	ft = xcalloc(1, sizeof *ft);
+	arena = arena_create(0);
+	ft = arena_calloc(arena, 1, sizeof *ft);
+	ft->arena = arena;
+	ft->item = item;
 	RB_INIT(&ft->tree);
 	ft->flags = flags;
 
@@ -548,16 +574,23 @@ format_create(struct cmdq_item *item, int flags)
 void
 format_free(struct format_tree *ft)
 {
-	struct format_entry	*fe, *fe1;
+	arena_free(ft->arena);
+}
 
-	RB_FOREACH_SAFE(fe, format_entry_tree, &ft->tree, fe1) {
-		RB_REMOVE(format_entry_tree, &ft->tree, fe);
-		free(fe->value);
-		free(fe->key);
-		free(fe);
-	}
+/* Find or add an entry. Any old value is left in the arena. */
+static struct format_entry *
+format_add_entry(struct format_tree *ft, const char *key)
+{
+	struct format_entry	*fe, fe_find;
 
-	free(ft);
+	fe_find.key = (char *)key;
+	fe = RB_FIND(format_entry_tree, &ft->tree, &fe_find);
+	if (fe == NULL) {
+		fe = arena_malloc(ft->arena, sizeof *fe);
+		fe->key = arena_strdup(ft->arena, key);
+		RB_INSERT(format_entry_tree, &ft->tree, fe);
+	}
+	return (fe);
 }
 
 /* Add a key-value pair. */
@@ -565,25 +598,15 @@ void
 format_add(struct format_tree *ft, const char *key, const char *fmt, ...)
 {
 	struct format_entry	*fe;
-	struct format_entry	*fe_now;
 	va_list			 ap;
 
-	fe = xmalloc(sizeof *fe);
-	fe->key = xstrdup(key);
-
-	fe_now = RB_INSERT(format_entry_tree, &ft->tree, fe);
-	if (fe_now != NULL) {
-		free(fe->key);
-		free(fe);
-		free(fe_now->value);
-		fe = fe_now;
-	}
+	fe = format_add_entry(ft, key);
 
 	fe->cb = NULL;
 	fe->t = 0;
 
 	va_start(ap, fmt);
-	xvasprintf(&fe->value, fmt, ap);
+	arena_vasprintf(ft->arena, &fe->value, fmt, ap);
 	va_end(ap);
 }
 
@@ -592,18 +615,8 @@ static void
 format_add_tv(struct format_tree *ft, const char *key, struct timeval *tv)
 {
 	struct format_entry	*fe;
-	struct format_entry	*fe_now;
-
-	fe = xmalloc(sizeof *fe);
-	fe->key = xstrdup(key);
 
-	fe_now = RB_INSERT(format_entry_tree, &ft->tree, fe);
-	if (fe_now != NULL) {
-		free(fe->key);
-		free(fe);
-		free(fe_now->value);
-		fe = fe_now;
-	}
+	fe = format_add_entry(ft, key);
 
 	fe->cb = NULL;
 	fe->t = tv->tv_sec;
@@ -616,18 +629,8 @@ static void
 format_add_cb(struct format_tree *ft, const char *key, format_cb cb)
 {
 	struct format_entry	*fe;
-	struct format_entry	*fe_now;
-
-	fe = xmalloc(sizeof *fe);
-	fe->key = xstrdup(key);
 
-	fe_now = RB_INSERT(format_entry_tree, &ft->tree, fe);
-	if (fe_now != NULL) {
-		free(fe->key);
-		free(fe);
-		free(fe_now->value);
-		fe = fe_now;
-	}
+	fe = format_add_entry(ft, key);
 
 	fe->cb = cb;
 	fe->t = 0;
@@ -645,6 +648,7 @@ format_find(struct format_tree *ft, const char *key, int modifiers)
 	static char		 s[64];
 	const char		*found;
 	char			*copy, *saved;
+	unsigned long long	 value;
 
 	found = NULL;
 
@@ -696,6 +700,12 @@ format_find(struct format_tree *ft, const char *key, int modifiers)
 		goto found;
 	}
 
+	if (strncmp(key, "stats_", 6) == 0 && stats_find(key + 6, &value) == 0) {
+		xsnprintf(s, sizeof s, "%llu", value);
+		found = s;
+		goto found;
+	}
+
 	if (~modifiers & FORMAT_TIMESTRING) {
 		envent = NULL;
 		if (ft->s != NULL)
@@ -983,6 +993,7 @@ format_expand(struct format_tree *ft, const char *fmt)
 
 	if (fmt == NULL)
 		return (xstrdup(""));
+	stats.formats++;
 
 	len = 64;
 	buf = xmalloc(len);
@@ -1152,6 +1163,7 @@ format_defaults_client(struct format_tree *ft, struct client *c)
 		format_add(ft, "client_tty", "%s", tty->path);
 	format_add(ft, "client_control_mode", "%d",
 		!!(c->flags & CLIENT_CONTROL));
+	format_add(ft, "client_bytes_written", "%llu", c->bytes_written);
 
 	if (tty->term_name != NULL)
 		format_add(ft, "client_termname", "%s", tty->term_name);
@@ -1282,6 +1294,10 @@ format_defaults_pane(struct format_tree *ft, struct window_pane *wp)
 
 	format_add(ft, "pane_tty", "%s", wp->tty);
 	format_add(ft, "pane_pid", "%ld", (long) wp->pid);
+	format_add(ft, "pane_bytes_read", "%llu", wp->bytes_read);
+	format_add(ft, "pane_pipe", "%d", wp->pipe_fd != -1);
+	format_add(ft, "pane_pipe_bytes", "%llu", wp->pipe_bytes);
+	format_add(ft, "pane_pipe_dropped", "%llu", wp->pipe_dropped);
 	format_add_cb(ft, "pane_start_command", format_cb_start_command);
 	format_add_cb(ft, "pane_current_command", format_cb_current_command);
 	format_add_cb(ft, "pane_current_path", format_cb_current_path);
@@ -60,11 +60,12 @@ static void	grid_string_cells_code(const struct grid_cell *,
 		    const struct grid_cell *, char *, size_t, int);
 
 /* Set cell as extended. */
-static struct grid_cell *
+static struct grid_extd_entry *
 grid_extended_cell(struct grid_line *gl, struct grid_cell_entry *gce,
     const struct grid_cell *gc)
 {
-	struct grid_cell	*gcp;
+	struct grid_extd_entry	*gee;
+	utf8_char		 uc;
 
 	gl->flags |= GRID_LINE_EXTENDED;
 
@@ -77,9 +78,14 @@ grid_extended_cell(struct grid_line *gl, struct grid_cell_entry *gce,
 	if (gce->offset >= gl->extdsize)
 		fatalx("offset too big");
 
-	gcp = &gl->extddata[gce->offset];
-	memcpy(gcp, gc, sizeof *gcp);
-	return (gcp);
+	gee = &gl->extddata[gce->offset];
+	utf8_from_data(&gc->data, &uc);
+	gee->data = uc;
+	gee->attr = gc->attr;
+	gee->flags = gc->flags;
+	gee->fg = gc->fg;
+	gee->bg = gc->bg;
+	return (gee);
 }
 
 /* Copy default into a cell. */
@@ -88,12 +94,12 @@ grid_clear_cell(struct grid *gd, u_int px, u_int py, u_int bg)
 {
 	struct grid_line	*gl = &gd->linedata[py];
 	struct grid_cell_entry	*gce = &gl->celldata[px];
-	struct grid_cell	*gc;
+	struct grid_extd_entry	*gee;
 
 	memcpy(gce, &grid_default_entry, sizeof *gce);
 	if (bg & COLOUR_FLAG_RGB) {
-		gc = grid_extended_cell(gl, gce, &grid_default_cell);
-		gc->bg = bg;
+		gee = grid_extended_cell(gl, gce, &grid_default_cell);
+		gee->bg = bg;
 	} else {
 		if (bg & COLOUR_FLAG_256)
 			gce->flags |= GRID_FLAG_BG256;
@@ -322,6 +328,7 @@ grid_get_cell(struct grid *gd, u_int px, u_int py, struct grid_cell *gc)
 {
 	struct grid_line	*gl;
 	struct grid_cell_entry	*gce;
+	struct grid_extd_entry	*gee;
 
 	if (grid_check_y(gd, py) != 0 || px >= gd->linedata[py].cellsize) {
 		memcpy(gc, &grid_default_cell, sizeof *gc);
@@ -332,10 +339,16 @@ grid_get_cell(struct grid *gd, u_int px, u_int py, struct grid_cell *gc)
 	gce = &gl->celldata[px];
 
 	if (gce->flags & GRID_FLAG_EXTENDED) {
-		if (gce->offset >= gl->extdsize)
+		if (gce->offset >= gl->extdsize) {
 			memcpy(gc, &grid_default_cell, sizeof *gc);
-		else
-			memcpy(gc, &gl->extddata[gce->offset], sizeof *gc);
+			return;
+		}
+		gee = &gl->extddata[gce->offset];
+		gc->flags = gee->flags;
+		gc->attr = gee->attr;
+		gc->fg = gee->fg;
+		gc->bg = gee->bg;
+		utf8_to_data(gee->data, &gc->data);
 		return;
 	}
 
@@ -610,9 +623,48 @@ grid_string_cells_bg(const struct grid_cell *gc, int *values)
 	return (n);
 }
 
+/* Append a decimal number to an escape sequence. */
+static size_t
+grid_string_cells_number(char *buf, int value)
+{
+	char	tmp[16];
+	size_t	n = 0, i;
+
+	if (value < 0)
+		value = 0;
+	do {
+		tmp[n++] = '0' + (value % 10);
+		value /= 10;
+	} while (value != 0);
+	for (i = 0; i < n; i++)
+		buf[i] = tmp[n - 1 - i];
+	return (n);
+}
+
+/* Append a fixed string to an escape sequence. */
+static size_t
+grid_string_cells_add(char *buf, const char *s, int escape_c0)
+{
+	size_t	n;
+
+	if (escape_c0) {
+		/* Add as octal, \033 and so on. */
+		buf[0] = '\\';
+		buf[1] = '0';
+		buf[2] = '0' + ((u_char)*s >> 3);
+		buf[3] = '0' + ((u_char)*s & 7);
+		n = 4;
+		s++;
+	} else
+		n = 0;
+	while (*s != '\0')
+		buf[n++] = *s++;
+	return (n);
+}
+
 /*
  * Returns ANSI code to set particular attributes (colour, bold and so on)
- * given a current state. The output buffer must be able to hold at least 57
+ * given a current state. The output buffer must be able to hold at least 128
  * bytes.
  */
 static void
@@ -620,10 +672,9 @@ grid_string_cells_code(const struct grid_cell *lastgc,
     const struct grid_cell *gc, char *buf, size_t len, int escape_c0)
 {
 	int	oldc[64], newc[64], s[128];
-	size_t	noldc, nnewc, n, i;
+	size_t	noldc, nnewc, n, i, off;
 	u_int	attr = gc->attr;
 	u_int	lastattr = lastgc->attr;
-	char	tmp[64];
 
 	struct {
 		u_int	mask;
@@ -639,6 +690,9 @@ grid_string_cells_code(const struct grid_cell *lastgc,
 	};
 	n = 0;
 
+	if (len < 128)
+		fatalx("buffer too small");
+
 	/* If any attribute is removed, begin with 0. */
 	for (i = 0; i < nitems(attrs); i++) {
 		if (!(attr & attrs[i].mask) && (lastattr & attrs[i].mask)) {
@@ -654,65 +708,75 @@ grid_string_cells_code(const struct grid_cell *lastgc,
 	}
 
 	/* If the foreground colour changed, append its parameters. */
-	nnewc = grid_string_cells_fg(gc, newc);
-	noldc = grid_string_cells_fg(lastgc, oldc);
-	if (nnewc != noldc || memcmp(newc, oldc, nnewc * sizeof newc[0]) != 0) {
-		for (i = 0; i < nnewc; i++)
-			s[n++] = newc[i];
+	if (gc->fg != lastgc->fg) {
+		nnewc = grid_string_cells_fg(gc, newc);
+		noldc = grid_string_cells_fg(lastgc, oldc);
+		if (nnewc != noldc ||
+		    memcmp(newc, oldc, nnewc * sizeof newc[0]) != 0) {
+			for (i = 0; i < nnewc; i++)
+				s[n++] = newc[i];
+		}
 	}
 
 	/* If the background colour changed, append its parameters. */
-	nnewc = grid_string_cells_bg(gc, newc);
-	noldc = grid_string_cells_bg(lastgc, oldc);
-	if (nnewc != noldc || memcmp(newc, oldc, nnewc * sizeof newc[0]) != 0) {
-		for (i = 0; i < nnewc; i++)
-			s[n++] = newc[i];
+	if (gc->bg != lastgc->bg) {
+		nnewc = grid_string_cells_bg(gc, newc);
+		noldc = grid_string_cells_bg(lastgc, oldc);
+		if (nnewc != noldc ||
+		    memcmp(newc, oldc, nnewc * sizeof newc[0]) != 0) {
+			for (i = 0; i < nnewc; i++)
+				s[n++] = newc[i];
+		}
 	}
 
 	/* If there are any parameters, append an SGR code. */
-	*buf = '\0';
+	off = 0;
 	if (n > 0) {
-		if (escape_c0)
-			strlcat(buf, "\\033[", len);
-		else
-			strlcat(buf, "\033[", len);
+		off += grid_string_cells_add(buf + off, "\033[", escape_c0);
 		for (i = 0; i < n; i++) {
+			off += grid_string_cells_number(buf + off, s[i]);
 			if (i + 1 < n)
-				xsnprintf(tmp, sizeof tmp, "%d;", s[i]);
-			else
-				xsnprintf(tmp, sizeof tmp, "%d", s[i]);
-			strlcat(buf, tmp, len);
+				buf[off++] = ';';
 		}
-		strlcat(buf, "m", len);
+		buf[off++] = 'm';
 	}
 
 	/* Append shift in/shift out if needed. */
-	if ((attr & GRID_ATTR_CHARSET) && !(lastattr & GRID_ATTR_CHARSET)) {
-		if (escape_c0)
-			strlcat(buf, "\\016", len);  /* SO */
-		else
-			strlcat(buf, "\016", len);  /* SO */
-	}
-	if (!(attr & GRID_ATTR_CHARSET) && (lastattr & GRID_ATTR_CHARSET)) {
-		if (escape_c0)
-			strlcat(buf, "\\017", len);  /* SI */
-		else
-			strlcat(buf, "\017", len);  /* SI */
+	if ((attr & GRID_ATTR_CHARSET) && !(lastattr & GRID_ATTR_CHARSET))
+		off += grid_string_cells_add(buf + off, "\016", escape_c0);
+	if (!(attr & GRID_ATTR_CHARSET) && (lastattr & GRID_ATTR_CHARSET))
+		off += grid_string_cells_add(buf + off, "\017", escape_c0);
+	buf[off] = '\0';
+}
+
+/* Make sure there is space in a string buffer. */
+static char *
+grid_string_cells_expand(char *buf, size_t *len, size_t need)
+{
+	while (*len < need) {
+		buf = xreallocarray(buf, 2, *len);
+		*len *= 2;
 	}
+	return (buf);
 }
 
-/* Convert cells into a string. */
+/*
+ * Convert cells into a string. Simple cells (one byte of data without RGB
+ * colour) are read directly from the line and copied a run at a time; only
+ * when the attributes change between runs is an escape sequence generated.
+ */
 char *
 grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx,
     struct grid_cell **lastgc, int with_codes, int escape_c0, int trim)
 {
-	struct grid_cell	 gc;
-	static struct grid_cell	 lastgc1;
-	const char		*data;
-	char			*buf, code[128];
-	size_t			 len, off, size, codelen;
-	u_int			 xx;
-	const struct grid_line	*gl;
+	struct grid_cell		 gc;
+	static struct grid_cell		 lastgc1;
+	const struct grid_cell_entry	*gce, *run;
+	const char			*data;
+	char				*buf, code[128];
+	size_t				 len, off, size, codelen;
+	u_int				 xx, end;
+	const struct grid_line		*gl;
 
 	if (lastgc != NULL && *lastgc == NULL) {
 		memcpy(&lastgc1, &grid_default_cell, sizeof lastgc1);
@@ -724,9 +788,54 @@ grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx,
 	off = 0;
 
 	gl = grid_peek_line(gd, py);
-	for (xx = px; xx < px + nx; xx++) {
-		if (gl == NULL || xx >= gl->cellsize)
-			break;
+	if (gl == NULL || px >= gl->cellsize)
+		end = px;
+	else if (nx > gl->cellsize - px)
+		end = gl->cellsize;
+	else
+		end = px + nx;
+
+	for (xx = px; xx < end; xx++) {
+		gce = &gl->celldata[xx];
+
+		if (~gce->flags & GRID_FLAG_EXTENDED) {
+			/* Emit any attribute change for the new run. */
+			if (with_codes) {
+				grid_get_cell(gd, xx, py, &gc);
+				grid_string_cells_code(*lastgc, &gc, code,
+				    sizeof code, escape_c0);
+				codelen = strlen(code);
+				memcpy(*lastgc, &gc, sizeof **lastgc);
+
+				buf = grid_string_cells_expand(buf, &len,
+				    off + codelen + 1);
+				memcpy(buf + off, code, codelen);
+				off += codelen;
+			}
+
+			/* Find the end of the run. */
+			for (run = gce + 1; run < gl->celldata + end; run++) {
+				if (run->flags & GRID_FLAG_EXTENDED)
+					break;
+				if (with_codes && (run->flags != gce->flags ||
+				    run->data.attr != gce->data.attr ||
+				    run->data.fg != gce->data.fg ||
+				    run->data.bg != gce->data.bg))
+					break;
+			}
+
+			/* And copy it, doubling backslashes if escaping. */
+			buf = grid_string_cells_expand(buf, &len,
+			    off + 2 * (run - gce) + 1);
+			for (; gce != run; gce++) {
+				if (escape_c0 && gce->data.data == '\\')
+					buf[off++] = '\\';
+				buf[off++] = gce->data.data;
+			}
+			xx = (run - gl->celldata) - 1;
+			continue;
+		}
+
 		grid_get_cell(gd, xx, py, &gc);
 		if (gc.flags & GRID_FLAG_PADDING)
 			continue;
@@ -746,10 +855,8 @@ grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx,
 			size = 2;
 		}
 
-		while (len < off + size + codelen + 1) {
-			buf = xreallocarray(buf, 2, len);
-			len *= 2;
-		}
+		buf = grid_string_cells_expand(buf, &len,
+		    off + size + codelen + 1);
 
 		if (codelen != 0) {
 			memcpy(buf + off, code, codelen);
@@ -842,18 +842,29 @@ input_set_state(struct window_pane *wp, const struct input_transition *itr)
 /* Parse input. */
 void
 input_parse(struct window_pane *wp)
+{
+	struct evbuffer	*evb = wp->event->input;
+	size_t		 len = EVBUFFER_LENGTH(evb);
+
+	if (len == 0)
+		return;
+	input_parse_buffer(wp, EVBUFFER_DATA(evb), len);
+	evbuffer_drain(evb, len);
+}
+
+/* Parse input from a buffer. */
+void
+input_parse_buffer(struct window_pane *wp, const u_char *buf, size_t len)
 {
 	struct input_ctx		*ictx = wp->ictx;
 	const struct input_transition	*itr;
-	struct evbuffer			*evb = wp->event->input;
-	u_char				*buf;
-	size_t				 len, off;
+	size_t				 off;
 
-	if (EVBUFFER_LENGTH(evb) == 0)
+	if (len == 0)
 		return;
 
 	window_update_activity(wp->window);
-	wp->flags |= PANE_CHANGED;
+	window_pane_dirty(wp, PANE_CHANGED);
 
 	/*
 	 * Open the screen. Use NULL wp if there is a mode set as don't want to
@@ -865,13 +876,17 @@ input_parse(struct window_pane *wp)
 		screen_write_start(&ictx->ctx, NULL, &wp->base);
 	ictx->wp = wp;
 
-	buf = EVBUFFER_DATA(evb);
-	len = EVBUFFER_LENGTH(evb);
-	notify_input(wp, evb);
+	notify_input(wp, buf, len);
 	off = 0;
 
-	log_debug("%s: %%%u %s, %zu bytes: %.*s", __func__, wp->id,
-	    ictx->state->name, len, (int)len, buf);
+	trace_add(TRACE_INPUT, wp->id, len, 0);
+	if (log_get_level() > 1) {
+		log_debug("%s: %%%u %s, %zu bytes: %.*s", __func__, wp->id,
+		    ictx->state->name, len, (int)len, buf);
+	} else {
+		log_debug("%s: %%%u %s, %zu bytes", __func__, wp->id,
+		    ictx->state->name, len);
+	}
 
 	/* Parse the input. */
 	while (off < len) {
@@ -907,8 +922,6 @@ input_parse(struct window_pane *wp)
 
 	/* Close the screen. */
 	screen_write_stop(&ictx->ctx);
-
-	evbuffer_drain(evb, len);
 }
 
 /* Split the parameter list (if any). */
@@ -1561,6 +1574,7 @@ input_csi_dispatch_sm_private(struct input_ctx *ictx)
 				break;
 			screen_write_mode_set(&ictx->ctx, MODE_FOCUSON);
 			wp->flags |= PANE_FOCUSPUSH; /* force update */
+			server_client_track_focus(wp);
 			break;
 		case 1005:
 			screen_write_mode_set(&ictx->ctx, MODE_MOUSE_UTF8);
@@ -34,95 +34,253 @@
 
 static void	job_callback(struct bufferevent *, short, void *);
 static void	job_write_callback(struct bufferevent *, void *);
+static struct job_environ *job_get_environ(struct session *);
+static void	job_free_environ(struct job_environ *);
+static int	job_start(struct job *);
+static void	job_start_waiting(void);
+
+/*
+ * Maximum number of jobs running at once. Any more are queued and started as
+ * earlier jobs finish.
+ */
+#define JOB_LIMIT 32
+
+/*
+ * Use vfork(2) if closefrom(3) is safe to call in the child, so the server
+ * address space (which may be very large with a lot of history) is not
+ * copied for every job.
+ */
+#ifdef HAVE_CLOSEFROM
+#define job_fork vfork
+#else
+#define job_fork fork
+#endif
+
+/*
+ * Environment for jobs, prebuilt as an array for execve(2). The most recent
+ * is kept and reused until the global or session environment changes.
+ */
+struct job_environ {
+	char		**envp;
+
+	int		  session;
+	u_int		  global_generation;
+	u_int		  session_generation;
+
+	u_int		  references;
+};
+static struct job_environ *job_last_environ;
 
 /* All jobs list. */
 struct joblist	all_jobs = LIST_HEAD_INITIALIZER(all_jobs);
 
+/* Jobs waiting to start. */
+static TAILQ_HEAD(, job) job_waiting = TAILQ_HEAD_INITIALIZER(job_waiting);
+static u_int	job_running;
+
+/* Get the environment for a job, building it if necessary. */
+static struct job_environ *
+job_get_environ(struct session *s)
+{
+	struct job_environ	*je = job_last_environ;
+	struct environ		*env;
+	int			 id = (s == NULL ? -1 : (int)s->id);
+	u_int			 sgen = (s == NULL ? 0 : environ_generation(s->environ));
+
+	if (je != NULL &&
+	    je->session == id &&
+	    je->global_generation == environ_generation(global_environ) &&
+	    je->session_generation == sgen) {
+		je->references++;
+		return (je);
+	}
+
+	env = environ_create();
+	environ_copy(global_environ, env);
+	if (s != NULL)
+		environ_copy(s->environ, env);
+	server_fill_environ(s, env);
+
+	je = xcalloc(1, sizeof *je);
+	je->envp = environ_array(env);
+	je->session = id;
+	je->global_generation = environ_generation(global_environ);
+	je->session_generation = sgen;
+	environ_free(env);
+
+	if (job_last_environ != NULL)
+		job_free_environ(job_last_environ);
+	job_last_environ = je;
+	je->references = 2;
+
+	return (je);
+}
+
+/* Drop a reference to a job environment. */
+static void
+job_free_environ(struct job_environ *je)
+{
+	if (--je->references != 0)
+		return;
+	if (je == job_last_environ)
+		job_last_environ = NULL;
+	environ_free_array(je->envp);
+	free(je);
+}
+
 /* Start a job running, if it isn't already. */
 struct job *
 job_run(const char *cmd, struct session *s, const char *cwd,
     void (*callbackfn)(struct job *), void (*freefn)(void *), void *data)
 {
 	struct job	*job;
-	struct environ	*env;
-	pid_t		 pid;
-	int		 nullfd, out[2];
-	const char	*home;
+	int		 out[2];
 
 	if (socketpair(AF_UNIX, SOCK_STREAM, PF_UNSPEC, out) != 0)
 		return (NULL);
 
-	env = environ_create();
-	environ_copy(global_environ, env);
-	if (s != NULL)
-		environ_copy(s->environ, env);
-	server_fill_environ(s, env);
+	job = xcalloc(1, sizeof *job);
+	job->state = JOB_WAITING;
 
-	switch (pid = fork()) {
-	case -1:
-		environ_free(env);
+	job->cmd = xstrdup(cmd);
+	job->pid = -1;
+	job->status = 0;
+
+	job->cwd = (cwd == NULL ? NULL : xstrdup(cwd));
+	job->env = job_get_environ(s);
+	job->peerfd = out[1];
+
+	job->callbackfn = callbackfn;
+	job->freefn = freefn;
+	job->data = data;
+
+	if (job_running >= JOB_LIMIT) {
+		log_debug("queue job %p: %s", job, job->cmd);
+		TAILQ_INSERT_TAIL(&job_waiting, job, wentry);
+	} else if (job_start(job) != 0) {
+		job_free_environ(job->env);
+		free(job->cwd);
+		free(job->cmd);
+		free(job);
 		close(out[0]);
 		close(out[1]);
 		return (NULL);
+	}
+
+	LIST_INSERT_HEAD(&all_jobs, job, lentry);
+
+	job->fd = out[0];
+	setblocking(job->fd, 0);
+
+	job->event = bufferevent_new(job->fd, NULL, job_write_callback,
+	    job_callback, job);
+	bufferevent_enable(job->event, EV_READ|EV_WRITE);
+
+	return (job);
+}
+
+/* Fork and execute a job. */
+static int
+job_start(struct job *job)
+{
+	const char	*home = find_home(), *cwd = job->cwd;
+	char		*argv[] = { (char *)"sh", (char *)"-c", job->cmd, NULL };
+	int		 nullfd, fd = job->peerfd;
+	sigset_t	 set, oldset;
+	pid_t		 pid;
+
+	/*
+	 * Block signals so that none are handled in the child before the
+	 * handlers have been reset.
+	 */
+	sigfillset(&set);
+	sigprocmask(SIG_BLOCK, &set, &oldset);
+
+	/*
+	 * Everything the child needs is prepared in advance: with vfork(2) it
+	 * must not allocate memory or touch state shared with the parent.
+	 */
+	switch (pid = job_fork()) {
+	case -1:
+		sigprocmask(SIG_SETMASK, &oldset, NULL);
+		return (-1);
 	case 0:		/* child */
 		clear_signals(1);
+		sigprocmask(SIG_SETMASK, &oldset, NULL);
 
 		if (cwd == NULL || chdir(cwd) != 0) {
-			if ((home = find_home()) == NULL || chdir(home) != 0)
+			if (home == NULL || chdir(home) != 0)
 				chdir("/");
 		}
 
-		environ_push(env);
-		environ_free(env);
-
-		if (dup2(out[1], STDIN_FILENO) == -1)
-			fatal("dup2 failed");
-		if (dup2(out[1], STDOUT_FILENO) == -1)
-			fatal("dup2 failed");
-		if (out[1] != STDIN_FILENO && out[1] != STDOUT_FILENO)
-			close(out[1]);
-		close(out[0]);
+		if (dup2(fd, STDIN_FILENO) == -1)
+			_exit(1);
+		if (dup2(fd, STDOUT_FILENO) == -1)
+			_exit(1);
+		if (fd != STDIN_FILENO && fd != STDOUT_FILENO)
+			close(fd);
 
 		nullfd = open(_PATH_DEVNULL, O_RDWR, 0);
 		if (nullfd < 0)
-			fatal("open failed");
+			_exit(1);
 		if (dup2(nullfd, STDERR_FILENO) == -1)
-			fatal("dup2 failed");
+			_exit(1);
 		if (nullfd != STDERR_FILENO)
 			close(nullfd);
 
 		closefrom(STDERR_FILENO + 1);
 
-		execl(_PATH_BSHELL, "sh", "-c", cmd, (char *) NULL);
-		fatal("execl failed");
+		execve(_PATH_BSHELL, argv, job->env->envp);
+		_exit(127);
 	}
 
 	/* parent */
-	environ_free(env);
-	close(out[1]);
+	sigprocmask(SIG_SETMASK, &oldset, NULL);
 
-	job = xmalloc(sizeof *job);
-	job->state = JOB_RUNNING;
+	close(job->peerfd);
+	job->peerfd = -1;
+	job_free_environ(job->env);
+	job->env = NULL;
+	free(job->cwd);
+	job->cwd = NULL;
 
-	job->cmd = xstrdup(cmd);
+	job->state = JOB_RUNNING;
 	job->pid = pid;
-	job->status = 0;
-
-	LIST_INSERT_HEAD(&all_jobs, job, lentry);
+	job_running++;
+	stats.jobs++;
 
-	job->callbackfn = callbackfn;
-	job->freefn = freefn;
-	job->data = data;
-
-	job->fd = out[0];
-	setblocking(job->fd, 0);
+	log_debug("run job %p: %s, pid %ld", job, job->cmd, (long) job->pid);
+	return (0);
+}
 
-	job->event = bufferevent_new(job->fd, NULL, job_write_callback,
-	    job_callback, job);
-	bufferevent_enable(job->event, EV_READ|EV_WRITE);
+/* Start as many waiting jobs as the limit allows. */
+static void
+job_start_waiting(void)
+{
+	struct job	*job;
 
-	log_debug("run job %p: %s, pid %ld", job, job->cmd, (long) job->pid);
-	return (job);
+	while (job_running < JOB_LIMIT) {
+		if ((job = TAILQ_FIRST(&job_waiting)) == NULL)
+			break;
+		TAILQ_REMOVE(&job_waiting, job, wentry);
+
+		if (job_start(job) != 0) {
+			/*
+			 * Closing the other end of the socket means the job
+			 * sees EOF and is freed as if it had exited.
+			 */
+			log_debug("job %p failed to start: %s", job, job->cmd);
+			close(job->peerfd);
+			job->peerfd = -1;
+			job_free_environ(job->env);
+			job->env = NULL;
+			free(job->cwd);
+			job->cwd = NULL;
+
+			job->status = 127 << 8;
+			job->state = JOB_DEAD;
+		}
+	}
 }
 
 /* Kill and free an individual job. */
@@ -134,6 +292,14 @@ job_free(struct job *job)
 	LIST_REMOVE(job, lentry);
 	free(job->cmd);
 
+	if (job->state == JOB_WAITING) {
+		TAILQ_REMOVE(&job_waiting, job, wentry);
+		close(job->peerfd);
+		job_free_environ(job->env);
+		free(job->cwd);
+	} else if (job->pid != -1)
+		job_running--;
+
 	if (job->freefn != NULL && job->data != NULL)
 		job->freefn(job->data);
 
@@ -145,6 +311,8 @@ job_free(struct job *job)
 		close(job->fd);
 
 	free(job);
+
+	job_start_waiting();
 }
 
 /* Called when output buffer falls below low watermark (default is 0). */
@@ -190,12 +358,18 @@ job_died(struct job *job, int status)
 
 	job->status = status;
 
+	/*
+	 * The job no longer counts against the limit once reaped, even if a
+	 * child it left behind is still holding its output open.
+	 */
+	job->pid = -1;
+	job_running--;
+	job_start_waiting();
+
 	if (job->state == JOB_CLOSED) {
 		if (job->callbackfn != NULL)
 			job->callbackfn(job);
 		job_free(job);
-	} else {
-		job->pid = -1;
+	} else
 		job->state = JOB_DEAD;
-	}
 }
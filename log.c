@@ -133,6 +133,7 @@ fatal(const char *msg, ...)
 	if (asprintf(&fmt, "fatal: %s: %s", msg, strerror(errno)) == -1)
 		exit(1);
 	log_vwrite(fmt, ap);
+	trace_fatal();
 	exit(1);
 }
 
@@ -147,5 +148,6 @@ fatalx(const char *msg, ...)
 	if (asprintf(&fmt, "fatal: %s", msg) == -1)
 		exit(1);
 	log_vwrite(fmt, ap);
+	trace_fatal();
 	exit(1);
 }
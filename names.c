@@ -25,18 +25,18 @@
 
 #include "tmux.h"
 
-static void	 name_time_callback(int, short, void *);
+static void	 name_time_callback(void *);
 static int	 name_time_expired(struct window *, struct timeval *);
 
 static char	*format_window_name(struct window *);
 
 static void
-name_time_callback(__unused int fd, __unused short events, void *arg)
+name_time_callback(void *arg)
 {
 	struct window	*w = arg;
 
-	/* The event loop will call check_window_name for us on the way out. */
 	log_debug("@%u name timer expired", w->id);
+	check_window_name(w);
 }
 
 static int
@@ -72,14 +72,14 @@ check_window_name(struct window *w)
 	gettimeofday(&tv, NULL);
 	left = name_time_expired(w, &tv);
 	if (left != 0) {
-		if (!event_initialized(&w->name_event))
-			evtimer_set(&w->name_event, name_time_callback, w);
-		if (!evtimer_pending(&w->name_event, NULL)) {
+		if (!timer_initialized(&w->name_timer))
+			timer_set(&w->name_timer, name_time_callback, w);
+		if (!timer_pending(&w->name_timer)) {
 			log_debug("@%u name timer queued (%d left)", w->id,
 			    left);
 			timerclear(&next);
 			next.tv_usec = left;
-			event_add(&w->name_event, &next);
+			timer_add(&w->name_timer, &next);
 		} else {
 			log_debug("@%u name timer already queued (%d left)",
 			    w->id, left);
@@ -87,8 +87,7 @@ check_window_name(struct window *w)
 		return;
 	}
 	memcpy(&w->name_time, &tv, sizeof w->name_time);
-	if (event_initialized(&w->name_event))
-		evtimer_del(&w->name_event);
+	timer_del(&w->name_timer);
 
 	w->active->flags &= ~PANE_CHANGED;
 
@@ -31,6 +31,17 @@
  * user sets an option or its value needs to be shown.
  */
 
+/*
+ * Hash of option names to their index in the table, so options can be stored
+ * in an array rather than looked up by name.
+ */
+#define OPTIONS_TABLE_HASH_SIZE 512
+static int	options_table_hash[OPTIONS_TABLE_HASH_SIZE];
+static u_int	options_table_size;
+
+static void	options_table_init(void);
+static u_int	options_table_hash_name(const char *);
+
 /* Choice option type lists. */
 static const char *options_table_mode_keys_list[] = {
 	"emacs", "vi", NULL
@@ -53,6 +64,9 @@ static const char *options_table_bell_action_list[] = {
 static const char *options_table_pane_status_list[] = {
 	"off", "top", "bottom", NULL
 };
+static const char *options_table_pipe_pane_overflow_list[] = {
+	"drop", "block", NULL
+};
 
 /* Server options. */
 const struct options_table_entry options_table[] = {
@@ -104,6 +118,14 @@ const struct options_table_entry options_table[] = {
 	  .default_num = 100
 	},
 
+	{ .name = "process-time",
+	  .type = OPTIONS_TABLE_NUMBER,
+	  .scope = OPTIONS_TABLE_SERVER,
+	  .minimum = 0,
+	  .maximum = INT_MAX,
+	  .default_num = 1000
+	},
+
 	{ .name = "quiet",
 	  .type = OPTIONS_TABLE_FLAG,
 	  .scope = OPTIONS_TABLE_SERVER,
@@ -116,6 +138,14 @@ const struct options_table_entry options_table[] = {
 	  .default_num = 1
 	},
 
+	{ .name = "slow-time",
+	  .type = OPTIONS_TABLE_NUMBER,
+	  .scope = OPTIONS_TABLE_SERVER,
+	  .minimum = 0,
+	  .maximum = INT_MAX,
+	  .default_num = 100
+	},
+
 	{ .name = "terminal-overrides",
 	  .type = OPTIONS_TABLE_STRING,
 	  .scope = OPTIONS_TABLE_SERVER,
@@ -709,6 +739,29 @@ const struct options_table_entry options_table[] = {
 	  .default_str = "default"
 	},
 
+	{ .name = "pipe-pane-limit",
+	  .type = OPTIONS_TABLE_NUMBER,
+	  .scope = OPTIONS_TABLE_WINDOW,
+	  .minimum = 0,
+	  .maximum = INT_MAX,
+	  .default_num = 0
+	},
+
+	{ .name = "pipe-pane-overflow",
+	  .type = OPTIONS_TABLE_CHOICE,
+	  .scope = OPTIONS_TABLE_WINDOW,
+	  .choices = options_table_pipe_pane_overflow_list,
+	  .default_num = PIPE_OVERFLOW_DROP
+	},
+
+	{ .name = "pipe-pane-rotate",
+	  .type = OPTIONS_TABLE_NUMBER,
+	  .scope = OPTIONS_TABLE_WINDOW,
+	  .minimum = 0,
+	  .maximum = INT_MAX,
+	  .default_num = 0
+	},
+
 	{ .name = "remain-on-exit",
 	  .type = OPTIONS_TABLE_FLAG,
 	  .scope = OPTIONS_TABLE_WINDOW,
@@ -927,6 +980,63 @@ options_table_populate_tree(enum options_table_scope scope, struct options *oo)
 	}
 }
 
+/* Hash an option name. */
+static u_int
+options_table_hash_name(const char *name)
+{
+	u_int	hash = 2166136261U;
+
+	for (; *name != '\0'; name++)
+		hash = (hash ^ (u_char)*name) * 16777619U;
+	return (hash & (OPTIONS_TABLE_HASH_SIZE - 1));
+}
+
+/* Build the hash of option names. */
+static void
+options_table_init(void)
+{
+	const struct options_table_entry	*oe;
+	u_int					 slot;
+
+	memset(options_table_hash, -1, sizeof options_table_hash);
+	for (oe = options_table; oe->name != NULL; oe++) {
+		if (options_table_size >= OPTIONS_TABLE_HASH_SIZE / 2)
+			fatalx("too many options");
+		slot = options_table_hash_name(oe->name);
+		while (options_table_hash[slot] != -1)
+			slot = (slot + 1) & (OPTIONS_TABLE_HASH_SIZE - 1);
+		options_table_hash[slot] = options_table_size++;
+	}
+}
+
+/* Get the number of options in the table. */
+u_int
+options_table_count(void)
+{
+	if (options_table_size == 0)
+		options_table_init();
+	return (options_table_size);
+}
+
+/* Get the index of an option in the table or -1 if it is not there. */
+int
+options_table_index(const char *name)
+{
+	u_int	slot;
+	int	idx;
+
+	if (options_table_size == 0)
+		options_table_init();
+
+	slot = options_table_hash_name(name);
+	while ((idx = options_table_hash[slot]) != -1) {
+		if (strcmp(options_table[idx].name, name) == 0)
+			return (idx);
+		slot = (slot + 1) & (OPTIONS_TABLE_HASH_SIZE - 1);
+	}
+	return (-1);
+}
+
 /* Print an option using its type from the table. */
 const char *
 options_table_print_entry(const struct options_table_entry *oe,
@@ -25,18 +25,27 @@
 #include "tmux.h"
 
 /*
- * Option handling; each option has a name, type and value and is stored in
- * a red-black tree.
+ * Option handling; each option has a name, type and value. Options from the
+ * table are stored in an array by their index in the table, so finding them
+ * does not need to compare names in each parent; other (user) options are
+ * stored in a red-black tree.
  */
 
 struct options {
+	struct options_entry	**array;
 	RB_HEAD(options_tree, options_entry) tree;
-	struct options	*parent;
+	struct options		 *parent;
 };
 
 static int	options_cmp(struct options_entry *, struct options_entry *);
 RB_GENERATE_STATIC(options_tree, options_entry, entry, options_cmp);
 
+/*
+ * Changed whenever any option is set or removed, so values derived from
+ * options may be cached until it changes.
+ */
+u_int	options_generation = 1;
+
 static int
 options_cmp(struct options_entry *o1, struct options_entry *o2)
 {
@@ -49,6 +58,7 @@ options_create(struct options *parent)
 	struct options	*oo;
 
 	oo = xcalloc(1, sizeof *oo);
+	oo->array = xcalloc(options_table_count(), sizeof *oo->array);
 	RB_INIT(&oo->tree);
 	oo->parent = parent;
 	return (oo);
@@ -57,8 +67,13 @@ options_create(struct options *parent)
 static void
 options_free1(struct options *oo, struct options_entry *o)
 {
-	RB_REMOVE(options_tree, &oo->tree, o);
-	free((char *)o->name);
+	options_generation++;
+	if (o->idx != -1)
+		oo->array[o->idx] = NULL;
+	else {
+		RB_REMOVE(options_tree, &oo->tree, o);
+		free((char *)o->name);
+	}
 	if (o->type == OPTIONS_STRING)
 		free(o->str);
 	free(o);
@@ -68,11 +83,19 @@ static struct options_entry *
 options_new(struct options *oo, const char *name)
 {
 	struct options_entry	*o;
+	int			 idx;
 
+	options_generation++;
 	if ((o = options_find1(oo, name)) == NULL) {
 		o = xmalloc(sizeof *o);
-		o->name = xstrdup(name);
-		RB_INSERT(options_tree, &oo->tree, o);
+		if ((idx = options_table_index(name)) != -1) {
+			o->name = options_table[idx].name;
+			oo->array[idx] = o;
+		} else {
+			o->name = xstrdup(name);
+			RB_INSERT(options_tree, &oo->tree, o);
+		}
+		o->idx = idx;
 		memcpy(&o->style, &grid_default_cell, sizeof o->style);
 	} else if (o->type == OPTIONS_STRING)
 		free(o->str);
@@ -83,12 +106,19 @@ void
 options_free(struct options *oo)
 {
 	struct options_entry	*o, *o1;
+	u_int			 i;
 
+	for (i = 0; i < options_table_count(); i++) {
+		if (oo->array[i] != NULL)
+			options_free1(oo, oo->array[i]);
+	}
+	free(oo->array);
 	RB_FOREACH_SAFE (o, options_tree, &oo->tree, o1)
 		options_free1(oo, o);
 	free(oo);
 }
 
+/* Iterate over user options; options from the table are not included. */
 struct options_entry *
 options_first(struct options *oo)
 {
@@ -105,6 +135,10 @@ struct options_entry *
 options_find1(struct options *oo, const char *name)
 {
 	struct options_entry	p;
+	int			idx;
+
+	if ((idx = options_table_index(name)) != -1)
+		return (oo->array[idx]);
 
 	p.name = (char *)name;
 	return (RB_FIND(options_tree, &oo->tree, &p));
@@ -114,6 +148,16 @@ struct options_entry *
 options_find(struct options *oo, const char *name)
 {
 	struct options_entry	*o, p;
+	int			 idx;
+
+	if ((idx = options_table_index(name)) != -1) {
+		do {
+			if ((o = oo->array[idx]) != NULL)
+				return (o);
+			oo = oo->parent;
+		} while (oo != NULL);
+		return (NULL);
+	}
 
 	p.name = (char *)name;
 	o = RB_FIND(options_tree, &oo->tree, &p);
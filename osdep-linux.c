@@ -21,6 +21,7 @@
 #include <sys/param.h>
 
 #include <event.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -30,35 +31,29 @@
 char *
 osdep_get_name(int fd, __unused char *tty)
 {
-	FILE	*f;
-	char	*path, *buf;
-	size_t	 len;
-	int	 ch;
-	pid_t	 pgrp;
+	static char	 buf[MAXPATHLEN + 1];
+	char		 path[64];
+	ssize_t		 n;
+	int		 f;
+	pid_t		 pgrp;
 
 	if ((pgrp = tcgetpgrp(fd)) == -1)
 		return (NULL);
 
-	xasprintf(&path, "/proc/%lld/cmdline", (long long) pgrp);
-	if ((f = fopen(path, "r")) == NULL) {
-		free(path);
+	/*
+	 * Only the first argument is wanted, so read once into a fixed buffer
+	 * rather than going through stdio a character at a time.
+	 */
+	xsnprintf(path, sizeof path, "/proc/%lld/cmdline", (long long) pgrp);
+	if ((f = open(path, O_RDONLY)) == -1)
 		return (NULL);
-	}
-	free(path);
+	n = read(f, buf, sizeof buf - 1);
+	close(f);
 
-	len = 0;
-	buf = NULL;
-	while ((ch = fgetc(f)) != EOF) {
-		if (ch == '\0')
-			break;
-		buf = xrealloc(buf, len + 2);
-		buf[len++] = ch;
-	}
-	if (buf != NULL)
-		buf[len] = '\0';
-
-	fclose(f);
-	return (buf);
+	if (n <= 0 || buf[0] == '\0')
+		return (NULL);
+	buf[n] = '\0';
+	return (xstrdup(buf));
 }
 
 char *
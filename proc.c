@@ -72,6 +72,8 @@ proc_event_cb(__unused int fd, short events, void *arg)
 			if (n == 0)
 				break;
 			log_debug("peer %p message %d", peer, imsg.hdr.type);
+			trace_add(TRACE_PROC_RECV, imsg.hdr.type,
+			    imsg.hdr.len - IMSG_HEADER_SIZE, 0);
 
 			if (peer_check_version(peer, &imsg) != 0) {
 				if (imsg.fd != -1)
@@ -151,6 +153,7 @@ proc_send(struct tmuxpeer *peer, enum msgtype type, int fd, const void *buf,
 	if (peer->flags & PEER_BAD)
 		return (-1);
 	log_debug("sending message %d to peer %p (%zu bytes)", type, peer, len);
+	trace_add(TRACE_PROC_SEND, type, len, 0);
 
 	retval = imsg_compose(ibuf, type, PROTOCOL_VERSION, -1, fd, vp, len);
 	if (retval != 1)
@@ -165,6 +168,12 @@ proc_send_s(struct tmuxpeer *peer, enum msgtype type, const char *s)
 	return (proc_send(peer, type, -1, s, strlen(s) + 1));
 }
 
+u_int
+proc_queued(struct tmuxpeer *peer)
+{
+	return (peer->ibuf.w.queued);
+}
+
 struct tmuxproc *
 proc_start(const char *name, struct event_base *base, int forkflag,
     void (*signalcb)(int))
@@ -0,0 +1,380 @@
+/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2016 Nicholas Marriott <nicholas.marriott@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmux.h"
+
+/*
+ * Headless pane replay. A window with a single pane and no process is created
+ * in a private session (not in the sessions tree) with a number of fake
+ * clients attached. Input is fed to the pane the same way as if it had been
+ * read from the pty, and the output each client's tty would have written is
+ * counted and discarded.
+ *
+ * Everything happens synchronously so nothing else in the server sees the
+ * fake session or clients.
+ */
+
+struct replay_client {
+	struct client	*c;
+	size_t		 written;
+	FILE		*f;
+};
+
+struct replay {
+	struct session		*s;
+	struct window		*w;
+	struct window_pane	*wp;
+
+	struct replay_client	*clients;
+	u_int			 nclients;
+};
+
+static void	replay_flush(struct replay *);
+static u_int	replay_hash(u_int, u_int);
+
+/* Create a headless pane with some clients. */
+struct replay *
+replay_create(u_int sx, u_int sy, u_int nclients, const char *term,
+    char **cause)
+{
+	struct replay		*r;
+	struct session		*s;
+	struct window		*w;
+	struct window_pane	*wp;
+	struct winlink		*wl;
+	struct client		*c;
+	struct tty		*tty;
+	struct tty_term		*tt;
+	u_int			 i;
+
+	tt = tty_term_find((char *)term, -1, cause);
+	if (tt == NULL)
+		return (NULL);
+
+	r = xcalloc(1, sizeof *r);
+
+	s = r->s = xcalloc(1, sizeof *s);
+	s->name = xstrdup("replay");
+	s->cwd = xstrdup("/");
+	s->sx = sx;
+	s->sy = sy;
+	RB_INIT(&s->windows);
+	TAILQ_INIT(&s->lastw);
+	s->environ = environ_create();
+	s->options = options_create(global_s_options);
+	options_set_number(s->options, "status", 0);
+	s->hooks = hooks_create(global_hooks);
+
+	w = r->w = window_create(sx, sy);
+	w->name = xstrdup("replay");
+	wp = r->wp = window_add_pane(w, NULL,
+	    options_get_number(s->options, "history-limit"));
+	layout_init(w, wp);
+	w->active = wp;
+
+	/* No pty, but replies to the application are written here. */
+	wp->event = bufferevent_new(-1, NULL, NULL, NULL, NULL);
+
+	wl = winlink_add(&s->windows, 0);
+	winlink_set_window(wl, w);
+	s->curw = wl;
+
+	r->nclients = nclients;
+	if (nclients != 0)
+		r->clients = xcalloc(nclients, sizeof *r->clients);
+	for (i = 0; i < nclients; i++) {
+		c = r->clients[i].c = xcalloc(1, sizeof *c);
+		c->session = s;
+		c->flags = CLIENT_UTF8|CLIENT_256COLOURS;
+		c->fd = -1;
+
+		tty = &c->tty;
+		tty->client = c;
+		tty->fd = -1;
+		tty->term_name = xstrdup(term);
+		tty->ccolour = xstrdup("");
+		tty->term_type = TTY_UNKNOWN;
+		tty->term = tt;
+		tt->references++;
+		tty->flags = TTY_OPENED|TTY_UTF8;
+		tty->term_flags = TERM_256COLOURS;
+		tty->sx = sx;
+		tty->sy = sy;
+		tty->event = bufferevent_new(-1, NULL, NULL, NULL, NULL);
+#ifdef LIBEVENT_VERSION_NUMBER
+		/* Otherwise libevent 2 only drains the output by writing it. */
+		evbuffer_unfreeze(tty->event->output, 1);
+#endif
+		tty_start_tty(tty);
+
+		TAILQ_INSERT_TAIL(&clients, c, entry);
+	}
+	tty_term_free(tt);
+
+	/*
+	 * Draw everything, as if the clients had just attached. This is left in
+	 * the buffer until the first input so it can go to a file if needed.
+	 */
+	for (i = 0; i < nclients; i++)
+		screen_redraw_screen(r->clients[i].c, 1, 1, 1);
+
+	return (r);
+}
+
+/* Free a headless pane and its clients. */
+void
+replay_free(struct replay *r)
+{
+	struct session	*s = r->s;
+	struct client	*c;
+	u_int		 i;
+
+	for (i = 0; i < r->nclients; i++) {
+		c = r->clients[i].c;
+		TAILQ_REMOVE(&clients, c, entry);
+
+		bufferevent_free(c->tty.event);
+		tty_term_free(c->tty.term);
+		free(c->tty.term_name);
+		free(c->tty.ccolour);
+		free(c);
+	}
+	free(r->clients);
+
+	bufferevent_free(r->wp->event);
+	r->wp->event = NULL;
+	alerts_dequeue(r->w);
+	winlink_remove(&s->windows, s->curw);
+
+	hooks_free(s->hooks);
+	options_free(s->options);
+	environ_free(s->environ);
+	free((void *)s->cwd);
+	free(s->name);
+	free(s);
+
+	free(r);
+}
+
+/* Get the pane. */
+struct window_pane *
+replay_pane(struct replay *r)
+{
+	return (r->wp);
+}
+
+/* Get the number of bytes written to a client's tty. */
+size_t
+replay_written(struct replay *r, u_int idx)
+{
+	return (r->clients[idx].written);
+}
+
+/* Write a client's tty output to a file as well as counting it. */
+void
+replay_set_file(struct replay *r, u_int idx, FILE *f)
+{
+	r->clients[idx].f = f;
+}
+
+/* Add a value to an FNV-1a hash. */
+static u_int
+replay_hash(u_int hash, u_int value)
+{
+	return ((hash ^ value) * 16777619U);
+}
+
+/*
+ * Get a checksum of the pane: every cell in the history and visible screen,
+ * the cursor position and the mode. Two replays of the same input at the same
+ * size should always give the same checksum.
+ */
+u_int
+replay_checksum(struct replay *r)
+{
+	struct screen		*s = r->wp->screen;
+	struct grid		*gd = s->grid;
+	struct grid_cell	 gc;
+	u_int			 hash, x, y, i, values[6];
+	const struct grid_line	*gl;
+
+	hash = 2166136261U;
+	for (y = 0; y < gd->hsize + gd->sy; y++) {
+		gl = grid_peek_line(gd, y);
+		hash = replay_hash(hash, gl->flags);
+		for (x = 0; x < gl->cellused; x++) {
+			grid_get_cell(gd, x, y, &gc);
+			hash = replay_hash(hash, gc.flags);
+			hash = replay_hash(hash, gc.attr);
+			hash = replay_hash(hash, gc.fg);
+			hash = replay_hash(hash, gc.bg);
+			for (i = 0; i < gc.data.size; i++)
+				hash = replay_hash(hash, gc.data.data[i]);
+		}
+		hash = replay_hash(hash, '\n');
+	}
+	values[0] = s->cx;
+	values[1] = s->cy;
+	values[2] = s->mode;
+	values[3] = s->rupper;
+	values[4] = s->rlower;
+	values[5] = gd->hsize;
+	for (i = 0; i < nitems(values); i++)
+		hash = replay_hash(hash, values[i]);
+	return (hash);
+}
+
+/*
+ * Do what the server loop would do after the pane has been read: redraw if
+ * needed and reset the cursor and mode. Then count and discard the output.
+ */
+static void
+replay_flush(struct replay *r)
+{
+	struct window_pane	*wp = r->wp;
+	struct screen		*s = wp->screen;
+	struct evbuffer		*evb;
+	struct tty		*tty;
+	u_int			 i;
+
+	for (i = 0; i < r->nclients; i++) {
+		tty = &r->clients[i].c->tty;
+
+		if (r->w->flags & WINDOW_REDRAW)
+			screen_redraw_screen(tty->client, 1, 1, 1);
+		else if (wp->flags & PANE_REDRAW)
+			screen_redraw_pane(tty->client, wp);
+
+		tty_region_off(tty);
+		tty_margin_off(tty);
+		if (wp->yoff + s->cy >= tty->sy)
+			tty_cursor(tty, 0, 0);
+		else
+			tty_cursor(tty, wp->xoff + s->cx, wp->yoff + s->cy);
+		tty_update_mode(tty, s->mode, s);
+		tty_reset(tty);
+
+		evb = tty->event->output;
+		if (r->clients[i].f != NULL) {
+			fwrite(EVBUFFER_DATA(evb), 1, EVBUFFER_LENGTH(evb),
+			    r->clients[i].f);
+		}
+		r->clients[i].written += EVBUFFER_LENGTH(evb);
+		evbuffer_drain(evb, EVBUFFER_LENGTH(evb));
+	}
+	r->w->flags &= ~WINDOW_REDRAW;
+	wp->flags &= ~PANE_REDRAW;
+}
+
+/* Feed input to the pane, in the same size pieces as it is read from a pty. */
+void
+replay_input(struct replay *r, const void *buf, size_t len)
+{
+	struct window_pane	*wp = r->wp;
+	const u_char		*cp = buf;
+	size_t			 n;
+	int			 flushed = 0;
+
+	while (len != 0) {
+		n = len;
+		if (n > READ_FAST_SIZE)
+			n = READ_FAST_SIZE;
+
+		input_parse_buffer(wp, cp, n);
+		replay_flush(r);
+		flushed = 1;
+
+		cp += n;
+		len -= n;
+	}
+
+	/* With no input, still flush the initial redraw. */
+	if (!flushed)
+		replay_flush(r);
+}
+
+/* Redraw everything on every client. */
+void
+replay_redraw(struct replay *r)
+{
+	r->w->flags |= WINDOW_REDRAW;
+	replay_flush(r);
+}
+
+/* Get a path relative to the client's working directory. */
+char *
+replay_get_path(struct client *c, const char *path)
+{
+	struct session	*s;
+	const char	*cwd;
+	char		*file;
+
+	if (c != NULL && c->session == NULL && c->cwd != NULL)
+		cwd = c->cwd;
+	else if (c != NULL && (s = c->session) != NULL && s->cwd != NULL)
+		cwd = s->cwd;
+	else
+		cwd = ".";
+
+	if (*path == '/')
+		file = xstrdup(path);
+	else
+		xasprintf(&file, "%s/%s", cwd, path);
+	return (file);
+}
+
+/* Read a file to replay, relative to the client's working directory. */
+char *
+replay_read_file(struct client *c, const char *path, size_t *size,
+    char **cause)
+{
+	char		*file, *buf;
+	FILE		*f;
+	size_t		 n;
+
+	file = replay_get_path(c, path);
+	if ((f = fopen(file, "rb")) == NULL) {
+		xasprintf(cause, "%s: %s", file, strerror(errno));
+		free(file);
+		return (NULL);
+	}
+
+	buf = NULL;
+	*size = 0;
+	do {
+		buf = xrealloc(buf, *size + BUFSIZ);
+		n = fread(buf + *size, 1, BUFSIZ, f);
+		*size += n;
+	} while (n == BUFSIZ);
+	if (ferror(f)) {
+		xasprintf(cause, "%s: read error", file);
+		free(buf);
+		buf = NULL;
+	}
+
+	fclose(f);
+	free(file);
+	return (buf);
+}
@@ -273,10 +273,11 @@ screen_redraw_make_pane_status(struct client *c, struct window *w,
 	struct screen_write_ctx	 ctx;
 	struct screen		 old;
 
+	window_update_options(w);
 	if (wp == w->active)
-		style_apply(&gc, w->options, "pane-active-border-style");
+		memcpy(&gc, &w->active_border_style, sizeof gc);
 	else
-		style_apply(&gc, w->options, "pane-border-style");
+		memcpy(&gc, &w->border_style, sizeof gc);
 
 	fmt = options_get_string(w->options, "pane-border-format");
 
@@ -315,14 +316,15 @@ screen_redraw_make_pane_status(struct client *c, struct window *w,
 static void
 screen_redraw_draw_pane_status(struct client *c, int pane_status)
 {
-	struct window		*w = c->session->curw->window;
-	struct options		*oo = c->session->options;
+	struct session		*s = c->session;
+	struct window		*w = s->curw->window;
 	struct tty		*tty = &c->tty;
 	struct window_pane	*wp;
 	int			 spos;
 	u_int			 yoff;
 
-	spos = options_get_number(oo, "status-position");
+	session_update_options(s);
+	spos = s->status_position;
 	TAILQ_FOREACH(wp, &w->panes, entry) {
 		if (!window_pane_visible(wp))
 			continue;
@@ -345,7 +347,6 @@ screen_redraw_update(struct client *c)
 {
 	struct window		*w = c->session->curw->window;
 	struct window_pane	*wp;
-	struct options		*wo = w->options;
 	int			 redraw;
 
 	if (c->message_string != NULL)
@@ -357,7 +358,8 @@ screen_redraw_update(struct client *c)
 	if (!redraw)
 		c->flags &= ~CLIENT_STATUS;
 
-	if (options_get_number(wo, "pane-border-status") != CELL_STATUS_OFF) {
+	window_update_options(w);
+	if (w->pane_status != CELL_STATUS_OFF) {
 		redraw = 0;
 		TAILQ_FOREACH(wp, &w->panes, entry) {
 			if (screen_redraw_make_pane_status(c, w, wp))
@@ -373,10 +375,9 @@ void
 screen_redraw_screen(struct client *c, int draw_panes, int draw_status,
     int draw_borders)
 {
-	struct options		*oo = c->session->options;
+	struct session		*s = c->session;
 	struct tty		*tty = &c->tty;
-	struct window		*w = c->session->curw->window;
-	struct options		*wo = w->options;
+	struct window		*w = s->curw->window;
 	u_int			 top;
 	int	 		 status, pane_status, spos;
 
@@ -385,11 +386,12 @@ screen_redraw_screen(struct client *c, int draw_panes, int draw_status,
 		return;
 
 	/* Get status line, er, status. */
-	spos = options_get_number(oo, "status-position");
+	session_update_options(s);
+	spos = s->status_position;
 	if (c->message_string != NULL || c->prompt_string != NULL)
 		status = 1;
 	else
-		status = options_get_number(oo, "status");
+		status = s->status;
 	top = 0;
 	if (status && spos == 0)
 		top = 1;
@@ -398,7 +400,8 @@ screen_redraw_screen(struct client *c, int draw_panes, int draw_status,
 
 	/* Draw the elements. */
 	if (draw_borders) {
-		pane_status = options_get_number(wo, "pane-border-status");
+		window_update_options(w);
+		pane_status = w->pane_status;
 		screen_redraw_draw_borders(c, status, pane_status, top);
 		if (pane_status != CELL_STATUS_OFF)
 			screen_redraw_draw_pane_status(c, pane_status);
@@ -435,7 +438,6 @@ screen_redraw_draw_borders(struct client *c, int status, int pane_status,
 {
 	struct session		*s = c->session;
 	struct window		*w = s->curw->window;
-	struct options		*oo = w->options;
 	struct tty		*tty = &c->tty;
 	struct window_pane	*wp;
 	struct grid_cell	 m_active_gc, active_gc, m_other_gc, other_gc;
@@ -471,8 +473,9 @@ screen_redraw_draw_borders(struct client *c, int status, int pane_status,
 			small = 0;
 	}
 
-	style_apply(&other_gc, oo, "pane-border-style");
-	style_apply(&active_gc, oo, "pane-active-border-style");
+	window_update_options(w);
+	memcpy(&other_gc, &w->border_style, sizeof other_gc);
+	memcpy(&active_gc, &w->active_border_style, sizeof active_gc);
 	active_gc.attr = other_gc.attr = GRID_ATTR_CHARSET;
 
 	memcpy(&m_other_gc, &other_gc, sizeof m_other_gc);
@@ -89,6 +89,7 @@ screen_write_stop(struct screen_write_ctx *ctx)
 
 	log_debug("%s: %u of %u written (dirty %u, skipped %u)", __func__,
 	    ctx->written, ctx->cells, ctx->cells - ctx->written, ctx->skipped);
+	trace_add(TRACE_SCREEN_WRITE, ctx->cells, ctx->written, ctx->skipped);
 }
 
 /* Flush outstanding cell writes. */
@@ -1042,6 +1043,7 @@ screen_write_cell(struct screen_write_ctx *ctx, const struct grid_cell *gc)
 	int			 insert, skip, selected, wrapped = 0;
 
 	ctx->cells++;
+	stats.cells++;
 
 	/* Ignore padding. */
 	if (gc->flags & GRID_FLAG_PADDING)
@@ -1057,15 +1059,18 @@ screen_write_cell(struct screen_write_ctx *ctx, const struct grid_cell *gc)
 		return;
 
 	/*
-	 * If the width is zero, combine onto the previous character, if
-	 * there is space.
+	 * If the character continues the grapheme cluster in the previous
+	 * cell, combine it onto that cell if there is space. A zero width
+	 * character that can't be combined is dropped.
 	 */
-	if (width == 0) {
+	if (width == 0 || (gc->data.size > 1 && s->cx != 0)) {
 		if (screen_write_combine(ctx, &gc->data) == 0) {
 			screen_write_initctx(ctx, &ttyctx);
 			tty_write(tty_cmd_utf8character, &ttyctx);
+			return;
 		}
-		return;
+		if (width == 0)
+			return;
 	}
 
 	/* Initialise the redraw context. */
@@ -1202,13 +1207,14 @@ screen_write_cell(struct screen_write_ctx *ctx, const struct grid_cell *gc)
 		ctx->skipped++;
 }
 
-/* Combine a UTF-8 zero-width character onto the previous. */
+/* Combine a UTF-8 character onto the grapheme cluster in the previous cell. */
 static int
 screen_write_combine(struct screen_write_ctx *ctx, const struct utf8_data *ud)
 {
 	struct screen		*s = ctx->s;
 	struct grid		*gd = s->grid;
 	struct grid_cell	 gc;
+	u_int			 cx;
 
 	/* Can't combine if at 0. */
 	if (s->cx == 0)
@@ -1218,19 +1224,29 @@ screen_write_combine(struct screen_write_ctx *ctx, const struct utf8_data *ud)
 	if (ud->size == 0)
 		fatalx("UTF-8 data empty");
 
-	/* Retrieve the previous cell. */
-	grid_view_get_cell(gd, s->cx - 1, s->cy, &gc);
+	/* Retrieve the previous cell, skipping padding after a wide one. */
+	cx = s->cx - 1;
+	grid_view_get_cell(gd, cx, s->cy, &gc);
+	while (cx != 0 && (gc.flags & GRID_FLAG_PADDING)) {
+		cx--;
+		grid_view_get_cell(gd, cx, s->cy, &gc);
+	}
+	if (gc.flags & GRID_FLAG_PADDING)
+		return (-1);
 
-	/* Check there is enough space. */
+	/* Check the character belongs and there is enough space. */
+	if (!utf8_in_cluster(&gc.data, ud))
+		return (-1);
 	if (gc.data.size + ud->size > sizeof gc.data.data)
 		return (-1);
 
 	/* Append the data. */
 	memcpy(gc.data.data + gc.data.size, ud->data, ud->size);
 	gc.data.size += ud->size;
+	gc.data.have = gc.data.size;
 
 	/* Set the new cell. */
-	grid_view_set_cell(gd, s->cx - 1, s->cy, &gc);
+	grid_view_set_cell(gd, cx, s->cy, &gc);
 
 	return (0);
 }
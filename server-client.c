@@ -47,6 +47,10 @@ static void	server_client_dispatch_command(struct client *, struct imsg *);
 static void	server_client_dispatch_identify(struct client *, struct imsg *);
 static void	server_client_dispatch_shell(struct client *);
 
+/* Panes which want focus events. */
+static TAILQ_HEAD(, window_pane) server_client_focus_panes =
+    TAILQ_HEAD_INITIALIZER(server_client_focus_panes);
+
 /* Check if this client is inside this server. */
 int
 server_client_check_nested(struct client *c)
@@ -159,6 +163,15 @@ server_client_create(int fd)
 	log_debug("new client %p", c);
 }
 
+/* Get client name for messages. */
+const char *
+server_client_name(struct client *c)
+{
+	if (c->ttyname == NULL || *c->ttyname == '\0')
+		return ("unknown");
+	return (c->ttyname);
+}
+
 /* Open client terminal if needed. */
 int
 server_client_open(struct client *c, char **cause)
@@ -229,6 +242,7 @@ server_client_lost(struct client *c)
 	if (event_initialized(&c->identify_timer))
 		evtimer_del(&c->identify_timer);
 
+	free(c->alerts_message);
 	free(c->message_string);
 	if (event_initialized(&c->message_timer))
 		evtimer_del(&c->message_timer);
@@ -696,6 +710,7 @@ server_client_handle_key(struct client *c, key_code key)
 	if (s == NULL || (c->flags & (CLIENT_DEAD|CLIENT_SUSPENDED)) != 0)
 		return;
 	w = s->curw->window;
+	trace_add(TRACE_CLIENT_KEY, c->pid, key & 0xffffffffULL, key >> 32);
 
 	/* Update the activity timer. */
 	if (gettimeofday(&c->activity_time, NULL) != 0)
@@ -883,34 +898,83 @@ server_client_loop(void)
 {
 	struct client		*c;
 	struct window		*w;
-	struct window_pane	*wp;
-	int			 focus;
+	struct window_pane	*wp, *wp1;
+	struct timeval		 start;
+	unsigned long long	 us;
+
+	/* Reflow any panes that were resized before they are redrawn. */
+	gettimeofday(&start, NULL);
+	window_pane_reflow_all();
+	if ((us = stats_time(STATS_REDRAW, &start)) != 0)
+		stats_slow(STATS_REDRAW, us, "reflow");
 
+	/*
+	 * Every client is checked rather than only those with flags set:
+	 * output to any pane moves the terminal cursor, which must be put back
+	 * for the active pane, and exiting clients wait for their output to
+	 * drain, neither of which sets a flag. There are also few clients
+	 * compared to windows and panes.
+	 */
 	TAILQ_FOREACH(c, &clients, entry) {
 		server_client_check_exit(c);
 		if (c->session != NULL) {
+			gettimeofday(&start, NULL);
 			server_client_check_redraw(c);
 			server_client_reset_state(c);
+			if ((us = stats_time(STATS_REDRAW, &start)) != 0) {
+				stats_slow(STATS_REDRAW, us, "client %s",
+				    server_client_name(c));
+			}
 		}
 	}
 
 	/*
 	 * Any windows will have been redrawn as part of clients, so clear
-	 * their flags now. Also check pane focus and resize.
+	 * their flags now. Also check pane resize and window names. Only
+	 * windows where something has changed are queued.
 	 */
-	focus = options_get_number(global_options, "focus-events");
-	RB_FOREACH(w, windows, &windows) {
+	while ((w = window_next_dirty()) != NULL) {
 		w->flags &= ~WINDOW_REDRAW;
 		TAILQ_FOREACH(wp, &w->panes, entry) {
-			if (wp->fd != -1) {
-				if (focus)
-					server_client_check_focus(wp);
+			if (wp->fd != -1)
 				server_client_check_resize(wp);
-			}
 			wp->flags &= ~PANE_REDRAW;
 		}
 		check_window_name(w);
 	}
+
+	/* Check focus for panes which want focus events. */
+	if (options_get_number(global_options, "focus-events")) {
+		TAILQ_FOREACH_SAFE(wp, &server_client_focus_panes, focus_entry,
+		    wp1) {
+			if (~wp->base.mode & MODE_FOCUSON) {
+				server_client_untrack_focus(wp);
+				continue;
+			}
+			if (wp->fd != -1)
+				server_client_check_focus(wp);
+		}
+	}
+}
+
+/* Add pane to the list of panes checked for focus changes. */
+void
+server_client_track_focus(struct window_pane *wp)
+{
+	if (wp->flags & PANE_FOCUSTRACK)
+		return;
+	wp->flags |= PANE_FOCUSTRACK;
+	TAILQ_INSERT_TAIL(&server_client_focus_panes, wp, focus_entry);
+}
+
+/* Remove pane from the list of panes checked for focus changes. */
+void
+server_client_untrack_focus(struct window_pane *wp)
+{
+	if (~wp->flags & PANE_FOCUSTRACK)
+		return;
+	wp->flags &= ~PANE_FOCUSTRACK;
+	TAILQ_REMOVE(&server_client_focus_panes, wp, focus_entry);
 }
 
 static void
@@ -1119,6 +1183,7 @@ server_client_check_redraw(struct client *c)
 
 	if (c->flags & (CLIENT_CONTROL|CLIENT_SUSPENDED))
 		return;
+	trace_add(TRACE_CLIENT_REDRAW, c->pid, c->flags, 0);
 
 	if (c->flags & (CLIENT_REDRAW|CLIENT_STATUS)) {
 		if (options_get_number(s->options, "set-titles"))
@@ -1133,8 +1198,10 @@ server_client_check_redraw(struct client *c)
 		tty_update_mode(tty, tty->mode, NULL);
 		screen_redraw_screen(c, 1, 1, 1);
 		c->flags &= ~(CLIENT_STATUS|CLIENT_BORDERS);
+		stats.redraw_full++;
 	} else if (c->flags & CLIENT_REDRAWWINDOW) {
 		tty_update_mode(tty, tty->mode, NULL);
+		stats.redraw_window++;
 		TAILQ_FOREACH(wp, &c->session->curw->window->panes, entry)
 			screen_redraw_pane(c, wp);
 		c->flags &= ~CLIENT_REDRAWWINDOW;
@@ -1143,6 +1210,7 @@ server_client_check_redraw(struct client *c)
 			if (wp->flags & PANE_REDRAW) {
 				tty_update_mode(tty, tty->mode, NULL);
 				screen_redraw_pane(c, wp);
+				stats.redraw_pane++;
 			}
 		}
 	}
@@ -1150,6 +1218,10 @@ server_client_check_redraw(struct client *c)
 	masked = c->flags & (CLIENT_BORDERS|CLIENT_STATUS);
 	if (masked != 0)
 		tty_update_mode(tty, tty->mode, NULL);
+	if (masked & CLIENT_BORDERS)
+		stats.redraw_borders++;
+	if (masked & CLIENT_STATUS)
+		stats.redraw_status++;
 	if (masked == CLIENT_BORDERS)
 		screen_redraw_screen(c, 0, 0, 1);
 	else if (masked == CLIENT_STATUS)
@@ -1198,6 +1270,8 @@ server_client_dispatch(struct imsg *imsg, void *arg)
 	const char		*data;
 	ssize_t			 datalen;
 	struct session		*s;
+	struct timeval		 start;
+	unsigned long long	 us;
 
 	if (c->flags & CLIENT_DEAD)
 		return;
@@ -1206,6 +1280,7 @@ server_client_dispatch(struct imsg *imsg, void *arg)
 		server_client_lost(c);
 		return;
 	}
+	gettimeofday(&start, NULL);
 
 	data = imsg->data;
 	datalen = imsg->hdr.len - IMSG_HEADER_SIZE;
@@ -1291,6 +1366,11 @@ server_client_dispatch(struct imsg *imsg, void *arg)
 		server_client_dispatch_shell(c);
 		break;
 	}
+
+	if ((us = stats_time(STATS_MESSAGE, &start)) != 0) {
+		stats_slow(STATS_MESSAGE, us, "message %u from client %s",
+		    imsg->hdr.type, server_client_name(c));
+	}
 }
 
 /* Callback when command is done. */
@@ -117,7 +117,7 @@ server_redraw_window(struct window *w)
 		if (c->session != NULL && c->session->curw->window == w)
 			server_redraw_client(c);
 	}
-	w->flags |= WINDOW_REDRAW;
+	window_dirty(w, WINDOW_REDRAW);
 }
 
 void
@@ -325,7 +325,7 @@ server_destroy_pane(struct window_pane *wp, int notify)
 		gc.attr |= GRID_ATTR_BRIGHT;
 		screen_write_puts(&ctx, &gc, "Pane is dead");
 		screen_write_stop(&ctx);
-		wp->flags |= PANE_REDRAW;
+		window_pane_dirty(wp, PANE_REDRAW);
 
 		return;
 	}
@@ -46,6 +46,7 @@ struct tmuxproc		*server_proc;
 static int		 server_fd;
 static int		 server_exit;
 static struct event	 server_ev_accept;
+static struct event	 server_ev_more;
 
 struct cmd_find_state	 marked_pane;
 
@@ -53,6 +54,7 @@ static int	server_create_socket(void);
 static int	server_loop(void);
 static void	server_send_exit(void);
 static void	server_accept(int, short, void *);
+static void	server_more(int, short, void *);
 static void	server_signal(int);
 static void	server_child_signal(void);
 static void	server_child_exited(pid_t, int);
@@ -147,6 +149,7 @@ server_start(struct event_base *base, int lockfd, char *lockfile)
 
 	if (log_get_level() > 3)
 		tty_create_log();
+	trace_start();
 
 #ifdef __OpenBSD__
 	if (pledge("stdio rpath wpath cpath fattr unix getpw recvfd proc exec "
@@ -164,6 +167,8 @@ server_start(struct event_base *base, int lockfd, char *lockfile)
 
 	gettimeofday(&start_time, NULL);
 
+	spawn_helper_start();
+
 	server_fd = server_create_socket();
 	if (server_fd == -1)
 		fatal("couldn't create socket");
@@ -181,6 +186,7 @@ server_start(struct event_base *base, int lockfd, char *lockfile)
 	status_prompt_load_history();
 
 	server_add_accept(0);
+	evtimer_set(&server_ev_more, server_more, NULL);
 
 	proc_loop(server_proc, server_loop);
 	status_prompt_save_history();
@@ -191,18 +197,33 @@ server_start(struct event_base *base, int lockfd, char *lockfile)
 static int
 server_loop(void)
 {
-	struct client	*c;
-	u_int		 items;
-
+	struct client		*c;
+	struct timeval		 start;
+	u_int			 items, total = 0;
+	unsigned long long	 us;
+
+	gettimeofday(&start, NULL);
+	cmdq_slice_start();
+	window_pane_process_reset();
 	do {
 		items = cmdq_next(NULL);
 		TAILQ_FOREACH(c, &clients, entry) {
 			if (c->flags & CLIENT_IDENTIFIED)
 				items += cmdq_next(c);
 		}
-	} while (items != 0);
+		total += items;
+	} while (items != 0 && !cmdq_slice_expired());
 
 	server_client_loop();
+	if ((us = stats_time(STATS_LOOP, &start)) != 0)
+		stats_slow(STATS_LOOP, us, "%u items", total);
+
+	/*
+	 * If the time slice ran out with commands still to run, make sure the
+	 * next loop happens without waiting for an event.
+	 */
+	if (cmdq_ready())
+		event_active(&server_ev_more, EV_TIMEOUT, 1);
 
 	if (!options_get_number(global_options, "exit-unattached")) {
 		if (!RB_EMPTY(&sessions))
@@ -225,6 +246,12 @@ server_loop(void)
 	return (1);
 }
 
+/* Callback to run the loop again for remaining commands. */
+static void
+server_more(__unused int fd, __unused short events, __unused void *data)
+{
+}
+
 /* Exit the server by killing all clients and windows. */
 static void
 server_send_exit(void)
@@ -378,13 +405,20 @@ server_child_signal(void)
 		case 0:
 			return;
 		}
-		if (WIFSTOPPED(status))
-			server_child_stopped(pid, status);
-		else if (WIFEXITED(status) || WIFSIGNALED(status))
-			server_child_exited(pid, status);
+		server_child_status(pid, status);
 	}
 }
 
+/* Handle a change in the status of a child. */
+void
+server_child_status(pid_t pid, int status)
+{
+	if (WIFSTOPPED(status))
+		server_child_stopped(pid, status);
+	else if (WIFEXITED(status) || WIFSIGNALED(status))
+		server_child_exited(pid, status);
+}
+
 /* Handle exited children. */
 static void
 server_child_exited(pid_t pid, int status)
@@ -257,6 +257,18 @@ session_lock_timer(__unused int fd, __unused short events, void *arg)
 	recalculate_sizes();
 }
 
+/* Update values cached from the session options if any options have changed. */
+void
+session_update_options(struct session *s)
+{
+	if (s->options_generation == options_generation)
+		return;
+	s->options_generation = options_generation;
+
+	s->status = options_get_number(s->options, "status");
+	s->status_position = options_get_number(s->options, "status-position");
+}
+
 /* Update activity time. */
 void
 session_update_activity(struct session *s, struct timeval *from)
@@ -651,16 +663,17 @@ session_group_synchronize_from(struct session *target)
 }
 
 /*
- * Synchronize a session with a target session. This means destroying all
- * winlinks then recreating them, then updating the current window, last window
- * stack and alerts.
+ * Synchronize a session with a target session. Only winlinks which differ are
+ * changed: those at indexes no longer in the target are removed, those at new
+ * indexes are added and those pointing to a different window are moved to the
+ * new window. Unchanged winlinks keep their place in the current window and
+ * last window stack, so only alerts need to be copied for them.
  */
 static void
 session_group_synchronize1(struct session *target, struct session *s)
 {
-	struct winlinks		 old_windows, *ww;
-	struct winlink_stack	 old_lastw;
-	struct winlink		*wl, *wl2;
+	struct winlinks		*ww;
+	struct winlink		*wl, *wl2, *wl3;
 
 	/* Don't do anything if the session is empty (it'll be destroyed). */
 	ww = &target->windows;
@@ -673,42 +686,42 @@ session_group_synchronize1(struct session *target, struct session *s)
 	    session_last(s) != 0 && session_previous(s, 0) != 0)
 		session_next(s, 0);
 
-	/* Save the old pointer and reset it. */
-	memcpy(&old_windows, &s->windows, sizeof old_windows);
-	RB_INIT(&s->windows);
+	/* Remove any winlinks at indexes the target no longer has. */
+	RB_FOREACH_SAFE(wl2, winlinks, &s->windows, wl3) {
+		if (winlink_find_by_index(ww, wl2->idx) != NULL)
+			continue;
+		if (winlink_find_by_window_id(ww, wl2->window->id) == NULL)
+			notify_session_window("window-unlinked", s, wl2->window);
+		if (s->curw == wl2)
+			s->curw = NULL;
+		winlink_stack_remove(&s->lastw, wl2);
+		winlink_remove(&s->windows, wl2);
+	}
 
-	/* Link all the windows from the target. */
+	/* Add new winlinks and move any with a different window. */
 	RB_FOREACH(wl, winlinks, ww) {
-		wl2 = winlink_add(&s->windows, wl->idx);
-		wl2->session = s;
-		winlink_set_window(wl2, wl->window);
-		notify_session_window("window-linked", s, wl2->window);
+		wl2 = winlink_find_by_index(&s->windows, wl->idx);
+		if (wl2 == NULL) {
+			wl2 = winlink_add(&s->windows, wl->idx);
+			wl2->session = s;
+			winlink_set_window(wl2, wl->window);
+			notify_session_window("window-linked", s, wl2->window);
+		} else if (wl2->window != wl->window) {
+			if (winlink_find_by_window_id(ww, wl2->window->id) ==
+			    NULL) {
+				notify_session_window("window-unlinked", s,
+				    wl2->window);
+			}
+			winlink_set_window(wl2, wl->window);
+			notify_session_window("window-linked", s, wl2->window);
+		}
+		wl2->flags &= ~WINLINK_ALERTFLAGS;
 		wl2->flags |= wl->flags & WINLINK_ALERTFLAGS;
 	}
 
-	/* Fix up the current window. */
-	if (s->curw != NULL)
-		s->curw = winlink_find_by_index(&s->windows, s->curw->idx);
-	else
+	/* Fix up the current window if it was removed. */
+	if (s->curw == NULL)
 		s->curw = winlink_find_by_index(&s->windows, target->curw->idx);
-
-	/* Fix up the last window stack. */
-	memcpy(&old_lastw, &s->lastw, sizeof old_lastw);
-	TAILQ_INIT(&s->lastw);
-	TAILQ_FOREACH(wl, &old_lastw, sentry) {
-		wl2 = winlink_find_by_index(&s->windows, wl->idx);
-		if (wl2 != NULL)
-			TAILQ_INSERT_TAIL(&s->lastw, wl2, sentry);
-	}
-
-	/* Then free the old winlinks list. */
-	while (!RB_EMPTY(&old_windows)) {
-		wl = RB_ROOT(&old_windows);
-		wl2 = winlink_find_by_window_id(&s->windows, wl->window->id);
-		if (wl2 == NULL)
-			notify_session_window("window-unlinked", s, wl->window);
-		winlink_remove(&old_windows, wl);
-	}
 }
 
 /* Renumber the windows across winlinks attached to a specific session. */
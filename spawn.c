@@ -0,0 +1,556 @@
+/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2016 Nicholas Marriott <nicholas.marriott@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "tmux.h"
+
+/*
+ * Pane spawn helper. This is a small process forked when the server starts,
+ * before it has grown large with history. Panes are created by sending it the
+ * command, environment and so on; it does the forkpty() and execs the command
+ * and returns the pid and pty to the server. This means creating a pane costs
+ * the same however much memory the server is using.
+ *
+ * Because the pane processes are children of the helper rather than the
+ * server, the helper reports when they exit or stop over a pipe.
+ *
+ * If the helper is not running for any reason, window_pane_spawn() forks the
+ * server instead.
+ */
+
+/* Messages between the server and helper. */
+enum spawn_msgtype {
+	SPAWN_MSG_FILE = 1,
+	SPAWN_MSG_ARGV,
+	SPAWN_MSG_ENVIRON,
+	SPAWN_MSG_CWD,
+	SPAWN_MSG_HOME,
+	SPAWN_MSG_START,
+	SPAWN_MSG_DONE
+};
+
+/* Start message data. */
+struct spawn_msg_start {
+	struct winsize	ws;
+
+	int		flags;
+#define SPAWN_EXECVP 0x1
+#define SPAWN_TIO 0x2
+
+	cc_t		cc[NCCS];
+};
+
+/* Done message data (sent with the pty fd). */
+struct spawn_msg_done {
+	pid_t		pid;
+	int		error;
+	char		tty[TTY_NAME_MAX];
+};
+
+/* Exit or stop status of a pane process. */
+struct spawn_status {
+	pid_t		pid;
+	int		status;
+};
+
+/* Server side. */
+static pid_t		 spawn_pid = -1;
+static struct imsgbuf	 spawn_ibuf;
+static int		 spawn_status_fd = -1;
+static struct event	 spawn_status_event;
+
+/* Helper side. */
+static struct imsgbuf	 spawn_helper_ibuf;
+static int		 spawn_signal_pipe[2];
+
+static void	spawn_helper_stop(void);
+static void	spawn_status_callback(int, short, void *);
+static int	spawn_send(u_int, int, const void *, size_t);
+static int	spawn_send_s(u_int, const char *);
+static __dead void spawn_helper_main(int, int);
+static void	spawn_helper_signal(int);
+static void	spawn_helper_reap(int);
+static void	spawn_helper_dispatch(struct imsg *);
+static void	spawn_helper_exec(struct spawn_msg_start *, char *, char **,
+		    char **, char *, char *);
+
+/* Start the helper. Called early in server startup. */
+void
+spawn_helper_start(void)
+{
+	int	pair[2], status[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, PF_UNSPEC, pair) != 0)
+		return;
+	if (pipe(status) != 0) {
+		close(pair[0]);
+		close(pair[1]);
+		return;
+	}
+
+	switch (spawn_pid = fork()) {
+	case -1:
+		close(pair[0]);
+		close(pair[1]);
+		close(status[0]);
+		close(status[1]);
+		return;
+	case 0:
+		close(pair[0]);
+		close(status[0]);
+		spawn_helper_main(pair[1], status[1]);
+		/* NOTREACHED */
+	}
+	close(pair[1]);
+	close(status[1]);
+
+	log_debug("spawn helper started (%ld)", (long)spawn_pid);
+
+	imsg_init(&spawn_ibuf, pair[0]);
+
+	spawn_status_fd = status[0];
+	setblocking(spawn_status_fd, 0);
+	event_set(&spawn_status_event, spawn_status_fd, EV_READ|EV_PERSIST,
+	    spawn_status_callback, NULL);
+	event_add(&spawn_status_event, NULL);
+}
+
+/* Stop using the helper, it has exited or is misbehaving. */
+static void
+spawn_helper_stop(void)
+{
+	if (spawn_pid == -1)
+		return;
+	log_debug("spawn helper stopped (%ld)", (long)spawn_pid);
+
+	kill(spawn_pid, SIGTERM);
+	spawn_pid = -1;
+
+	close(spawn_ibuf.fd);
+	imsg_clear(&spawn_ibuf);
+
+	event_del(&spawn_status_event);
+	close(spawn_status_fd);
+	spawn_status_fd = -1;
+}
+
+/* Pane process status reported by the helper. */
+static void
+spawn_status_callback(int fd, __unused short events, __unused void *data)
+{
+	struct spawn_status	ss[32];
+	ssize_t			n;
+	size_t			i;
+
+	n = read(fd, ss, sizeof ss);
+	if (n == -1 && (errno == EINTR || errno == EAGAIN))
+		return;
+	if (n <= 0) {
+		spawn_helper_stop();
+		return;
+	}
+
+	/* Writes are smaller than PIPE_BUF so are never split. */
+	for (i = 0; i < n / sizeof *ss; i++) {
+		log_debug("spawn helper: pid %ld status %d", (long)ss[i].pid,
+		    ss[i].status);
+		server_child_status(ss[i].pid, ss[i].status);
+	}
+}
+
+/* Send a message to the helper. */
+static int
+spawn_send(u_int type, int fd, const void *buf, size_t len)
+{
+	if (len > MAX_IMSGSIZE - IMSG_HEADER_SIZE)
+		return (-1);
+	if (imsg_compose(&spawn_ibuf, type, PROTOCOL_VERSION, -1, fd, buf,
+	    len) != 1)
+		return (-1);
+	return (0);
+}
+
+/* Send a string message to the helper. */
+static int
+spawn_send_s(u_int type, const char *s)
+{
+	return (spawn_send(type, -1, s, strlen(s) + 1));
+}
+
+/*
+ * Ask the helper to start a pane. Returns the pid with the pane fd and tty
+ * filled in, -1 with errno set on failure, or 0 if the helper is not available
+ * and the server should fork the pane itself.
+ */
+pid_t
+spawn_helper_pane(struct window_pane *wp, const char *path,
+    struct environ *env, struct termios *tio, struct winsize *ws)
+{
+	struct spawn_msg_start	 start;
+	struct spawn_msg_done	 done;
+	struct environ		*env2;
+	struct imsg		 imsg;
+	const char		*ptr, *home;
+	char			*argv0, **envp, **cp;
+	int			 i, error;
+	ssize_t			 n;
+
+	if (spawn_pid == -1)
+		return (0);
+
+	env2 = environ_create();
+	environ_copy(env, env2);
+	if (path != NULL)
+		environ_set(env2, "PATH", "%s", path);
+	environ_set(env2, "TMUX_PANE", "%%%u", wp->id);
+	environ_set(env2, "SHELL", "%s", wp->shell);
+	envp = environ_array(env2);
+	environ_free(env2);
+
+	memset(&start, 0, sizeof start);
+	memcpy(&start.ws, ws, sizeof start.ws);
+	if (tio != NULL) {
+		start.flags |= SPAWN_TIO;
+		memcpy(start.cc, tio->c_cc, sizeof start.cc);
+	}
+
+	/*
+	 * If given one argument, assume it should be passed to sh -c; with
+	 * more than one argument, use execvp(). If there is no arguments,
+	 * create a login shell. This matches window_pane_spawn().
+	 */
+	error = 0;
+	ptr = strrchr(wp->shell, '/');
+	if (wp->argc > 1) {
+		start.flags |= SPAWN_EXECVP;
+		error |= spawn_send_s(SPAWN_MSG_FILE, wp->argv[0]);
+		for (i = 0; i < wp->argc; i++)
+			error |= spawn_send_s(SPAWN_MSG_ARGV, wp->argv[i]);
+	} else {
+		error |= spawn_send_s(SPAWN_MSG_FILE, wp->shell);
+		if (ptr != NULL && *(ptr + 1) != '\0')
+			ptr++;
+		else
+			ptr = wp->shell;
+		if (wp->argc == 1) {
+			error |= spawn_send_s(SPAWN_MSG_ARGV, ptr);
+			error |= spawn_send_s(SPAWN_MSG_ARGV, "-c");
+			error |= spawn_send_s(SPAWN_MSG_ARGV, wp->argv[0]);
+		} else {
+			xasprintf(&argv0, "-%s", ptr);
+			error |= spawn_send_s(SPAWN_MSG_ARGV, argv0);
+			free(argv0);
+		}
+	}
+	for (cp = envp; *cp != NULL; cp++)
+		error |= spawn_send_s(SPAWN_MSG_ENVIRON, *cp);
+	environ_free_array(envp);
+	error |= spawn_send_s(SPAWN_MSG_CWD, wp->cwd);
+	if ((home = find_home()) != NULL)
+		error |= spawn_send_s(SPAWN_MSG_HOME, home);
+	error |= spawn_send(SPAWN_MSG_START, -1, &start, sizeof start);
+
+	if (error != 0) {
+		/* Something was too long, clear the queue and fork instead. */
+		imsg_clear(&spawn_ibuf);
+		return (0);
+	}
+	if (imsg_flush(&spawn_ibuf) != 0)
+		goto fail;
+
+	/* Wait for the reply, the socket is blocking. */
+	for (;;) {
+		if ((n = imsg_get(&spawn_ibuf, &imsg)) == -1)
+			goto fail;
+		if (n != 0)
+			break;
+		n = imsg_read(&spawn_ibuf);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 || n == 0)
+			goto fail;
+	}
+	if (imsg.hdr.type != SPAWN_MSG_DONE ||
+	    imsg.hdr.len - IMSG_HEADER_SIZE != sizeof done) {
+		if (imsg.fd != -1)
+			close(imsg.fd);
+		imsg_free(&imsg);
+		goto fail;
+	}
+	memcpy(&done, imsg.data, sizeof done);
+	imsg_free(&imsg);
+
+	if (done.pid == -1) {
+		errno = done.error;
+		return (-1);
+	}
+	wp->fd = imsg.fd;
+	strlcpy(wp->tty, done.tty, sizeof wp->tty);
+
+	log_debug("spawn helper: pane %%%u pid %ld", wp->id, (long)done.pid);
+	return (done.pid);
+
+fail:
+	spawn_helper_stop();
+	return (0);
+}
+
+/* Helper main loop. */
+static __dead void
+spawn_helper_main(int fd, int status_fd)
+{
+	struct imsgbuf	*ibuf = &spawn_helper_ibuf;
+	struct imsg	 imsg;
+	struct pollfd	 pfd[2];
+	ssize_t		 n;
+
+	setproctitle("spawn (%s)", socket_path);
+
+	/* Move our descriptors out of the way and close everything else. */
+	log_close();
+	if (dup2(fd, STDERR_FILENO + 1) == -1)
+		_exit(1);
+	if (dup2(status_fd, STDERR_FILENO + 2) == -1)
+		_exit(1);
+	fd = STDERR_FILENO + 1;
+	status_fd = STDERR_FILENO + 2;
+	closefrom(STDERR_FILENO + 3);
+	log_open("spawn");
+
+	clear_signals(1);
+	if (pipe(spawn_signal_pipe) != 0)
+		fatal("pipe failed");
+	setblocking(spawn_signal_pipe[0], 0);
+	setblocking(spawn_signal_pipe[1], 0);
+	signal(SIGCHLD, spawn_helper_signal);
+
+	imsg_init(ibuf, fd);
+	for (;;) {
+		pfd[0].fd = fd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = spawn_signal_pipe[0];
+		pfd[1].events = POLLIN;
+		if (poll(pfd, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			fatal("poll failed");
+		}
+
+		if (pfd[1].revents & POLLIN)
+			spawn_helper_reap(status_fd);
+
+		if (pfd[0].revents & (POLLIN|POLLHUP|POLLERR)) {
+			n = imsg_read(ibuf);
+			if (n == -1 && (errno == EINTR || errno == EAGAIN))
+				continue;
+			if (n == -1 || n == 0)
+				break;
+			for (;;) {
+				if ((n = imsg_get(ibuf, &imsg)) == -1)
+					fatalx("imsg_get failed");
+				if (n == 0)
+					break;
+				spawn_helper_dispatch(&imsg);
+				imsg_free(&imsg);
+			}
+			if (imsg_flush(ibuf) != 0)
+				break;
+		}
+	}
+	log_debug("spawn helper exiting");
+	_exit(0);
+}
+
+/* SIGCHLD handler in the helper, wakes up the main loop. */
+static void
+spawn_helper_signal(__unused int sig)
+{
+	int	saved_errno = errno;
+
+	write(spawn_signal_pipe[1], "", 1);
+	errno = saved_errno;
+}
+
+/* Collect exited or stopped children and tell the server. */
+static void
+spawn_helper_reap(int status_fd)
+{
+	struct spawn_status	ss;
+	char			buf[64];
+	int			status;
+	pid_t			pid;
+
+	while (read(spawn_signal_pipe[0], buf, sizeof buf) > 0)
+		/* nothing */;
+
+	for (;;) {
+		pid = waitpid(WAIT_ANY, &status, WNOHANG|WUNTRACED);
+		if (pid == -1 && errno == EINTR)
+			continue;
+		if (pid == -1 || pid == 0)
+			return;
+
+		ss.pid = pid;
+		ss.status = status;
+		if (write(status_fd, &ss, sizeof ss) != sizeof ss)
+			fatal("write failed");
+	}
+}
+
+/* Handle a message from the server. */
+static void
+spawn_helper_dispatch(struct imsg *imsg)
+{
+	static char			 *file, *cwd, *home, **argv, **envp;
+	static u_int			  argc, envc;
+	struct spawn_msg_start		  start;
+	struct spawn_msg_done		  done;
+	char				 *data = imsg->data;
+	size_t				  datalen;
+	int				  master;
+	u_int				  i;
+
+	datalen = imsg->hdr.len - IMSG_HEADER_SIZE;
+	if (imsg->hdr.type != SPAWN_MSG_START &&
+	    (datalen == 0 || data[datalen - 1] != '\0'))
+		fatalx("bad string");
+
+	switch (imsg->hdr.type) {
+	case SPAWN_MSG_FILE:
+		free(file);
+		file = xstrdup(data);
+		return;
+	case SPAWN_MSG_ARGV:
+		argv = xreallocarray(argv, argc + 2, sizeof *argv);
+		argv[argc++] = xstrdup(data);
+		argv[argc] = NULL;
+		return;
+	case SPAWN_MSG_ENVIRON:
+		envp = xreallocarray(envp, envc + 2, sizeof *envp);
+		envp[envc++] = xstrdup(data);
+		envp[envc] = NULL;
+		return;
+	case SPAWN_MSG_CWD:
+		free(cwd);
+		cwd = xstrdup(data);
+		return;
+	case SPAWN_MSG_HOME:
+		free(home);
+		home = xstrdup(data);
+		return;
+	case SPAWN_MSG_START:
+		break;
+	default:
+		fatalx("unexpected message");
+	}
+
+	if (datalen != sizeof start)
+		fatalx("bad SPAWN_MSG_START size");
+	memcpy(&start, data, sizeof start);
+	if (file == NULL || argv == NULL)
+		fatalx("incomplete spawn request");
+	if (envp == NULL)
+		envp = xcalloc(1, sizeof *envp);
+
+	memset(&done, 0, sizeof done);
+	switch (done.pid = forkpty(&master, done.tty, NULL, &start.ws)) {
+	case -1:
+		done.error = errno;
+		master = -1;
+		break;
+	case 0:
+		spawn_helper_exec(&start, file, argv, envp, cwd, home);
+		/* NOTREACHED */
+	}
+	log_debug("spawn: %s pid %ld", file, (long)done.pid);
+
+	for (i = 0; i < argc; i++)
+		free(argv[i]);
+	free(argv);
+	argv = NULL;
+	argc = 0;
+	for (i = 0; i < envc; i++)
+		free(envp[i]);
+	free(envp);
+	envp = NULL;
+	envc = 0;
+	free(file);
+	file = NULL;
+	free(cwd);
+	cwd = NULL;
+	free(home);
+	home = NULL;
+
+	/* The fd is closed once it has been sent. */
+	if (imsg_compose(&spawn_helper_ibuf, SPAWN_MSG_DONE, PROTOCOL_VERSION,
+	    -1, master, &done, sizeof done) != 1)
+		fatalx("imsg_compose failed");
+}
+
+/* Set up and execute the pane command in the child. */
+static __dead void
+spawn_helper_exec(struct spawn_msg_start *start, char *file, char **argv,
+    char **envp, char *cwd, char *home)
+{
+	struct termios	tio2;
+	struct sigaction sigact;
+
+	if (cwd == NULL || chdir(cwd) != 0) {
+		if (home == NULL || chdir(home) != 0)
+			chdir("/");
+	}
+
+	if (tcgetattr(STDIN_FILENO, &tio2) != 0)
+		fatal("tcgetattr failed");
+	if (start->flags & SPAWN_TIO)
+		memcpy(tio2.c_cc, start->cc, sizeof tio2.c_cc);
+	tio2.c_cc[VERASE] = '\177';
+#ifdef IUTF8
+	tio2.c_iflag |= IUTF8;
+#endif
+	if (tcsetattr(STDIN_FILENO, TCSANOW, &tio2) != 0)
+		fatal("tcgetattr failed");
+
+	closefrom(STDERR_FILENO + 1);
+
+	memset(&sigact, 0, sizeof sigact);
+	sigemptyset(&sigact.sa_mask);
+	sigact.sa_handler = SIG_DFL;
+	sigaction(SIGCHLD, &sigact, NULL);
+	log_close();
+
+	environ = envp;
+	if (start->flags & SPAWN_EXECVP) {
+		execvp(file, argv);
+		fatal("execvp failed");
+	}
+	execv(file, argv);
+	fatal("execv failed");
+}
@@ -0,0 +1,210 @@
+/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2016 Nicholas Marriott <nicholas.marriott@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tmux.h"
+
+/*
+ * Server statistics. These are plain counters incremented where the work is
+ * done, so they are always on and cost almost nothing. They are shown by
+ * show-stats and as formats with a stats_ prefix.
+ *
+ * The server loop, commands and the main event callbacks are also timed and
+ * counted into a histogram for each type. Any taking longer than the
+ * slow-time option is logged and kept in a short list with a description of
+ * the command, pane or client responsible.
+ */
+
+#define STATS_SLOW_LIMIT 50
+
+#define STATS_LATENCY(name, type)					\
+	{ name "s", offsetof(struct stats, latency[type].count) },	\
+	{ name "_max", offsetof(struct stats, latency[type].max) },	\
+	{ name "_100us", offsetof(struct stats, latency[type].time[0]) }, \
+	{ name "_1ms", offsetof(struct stats, latency[type].time[1]) },	\
+	{ name "_10ms", offsetof(struct stats, latency[type].time[2]) }, \
+	{ name "_100ms", offsetof(struct stats, latency[type].time[3]) }, \
+	{ name "_1s", offsetof(struct stats, latency[type].time[4]) },	\
+	{ name "_slow", offsetof(struct stats, latency[type].time[5]) }
+
+struct stats		stats;
+struct stats_slow_list	stats_slow_list =
+    TAILQ_HEAD_INITIALIZER(stats_slow_list);
+
+static u_int		stats_slow_count;
+static u_int		stats_slow_time;
+static u_int		stats_generation;
+
+static const char *stats_type_names[] = {
+	[STATS_LOOP] = "loop",
+	[STATS_COMMAND] = "command",
+	[STATS_CALLBACK] = "callback",
+	[STATS_PANE_READ] = "pane_read",
+	[STATS_TTY_READ] = "tty_read",
+	[STATS_MESSAGE] = "message",
+	[STATS_REDRAW] = "redraw",
+};
+
+static const struct {
+	const char	*name;
+	size_t		 offset;
+} stats_table[] = {
+	{ "pane_bytes", offsetof(struct stats, pane_bytes) },
+	{ "client_bytes", offsetof(struct stats, client_bytes) },
+	{ "pipe_bytes", offsetof(struct stats, pipe_bytes) },
+	{ "pipe_dropped", offsetof(struct stats, pipe_dropped) },
+	{ "cells", offsetof(struct stats, cells) },
+	{ "tty_commands", offsetof(struct stats, tty_commands) },
+	{ "redraw_full", offsetof(struct stats, redraw_full) },
+	{ "redraw_window", offsetof(struct stats, redraw_window) },
+	{ "redraw_pane", offsetof(struct stats, redraw_pane) },
+	{ "redraw_status", offsetof(struct stats, redraw_status) },
+	{ "redraw_borders", offsetof(struct stats, redraw_borders) },
+	{ "formats", offsetof(struct stats, formats) },
+	{ "jobs", offsetof(struct stats, jobs) },
+	STATS_LATENCY("loop", STATS_LOOP),
+	STATS_LATENCY("command", STATS_COMMAND),
+	STATS_LATENCY("callback", STATS_CALLBACK),
+	STATS_LATENCY("pane_read", STATS_PANE_READ),
+	STATS_LATENCY("tty_read", STATS_TTY_READ),
+	STATS_LATENCY("message", STATS_MESSAGE),
+	STATS_LATENCY("redraw", STATS_REDRAW),
+};
+
+/*
+ * Record how long something took, from start until now. Returns the time in
+ * microseconds if it was slow or zero if not.
+ */
+unsigned long long
+stats_time(enum stats_type type, struct timeval *start)
+{
+	struct stats_latency	*sl = &stats.latency[type];
+	struct timeval		 tv;
+	unsigned long long	 us, limit;
+	u_int			 i;
+
+	gettimeofday(&tv, NULL);
+	if (timercmp(&tv, start, <))
+		return (0);
+	timersub(&tv, start, &tv);
+	us = tv.tv_sec * 1000000ULL + tv.tv_usec;
+	trace_add(TRACE_TIME, type, us > UINT_MAX ? UINT_MAX : us, 0);
+
+	sl->count++;
+	if (us > sl->max)
+		sl->max = us;
+
+	limit = 100;
+	for (i = 0; i < STATS_BUCKETS - 1; i++) {
+		if (us < limit)
+			break;
+		limit *= 10;
+	}
+	sl->time[i]++;
+
+	if (stats_generation != options_generation) {
+		stats_generation = options_generation;
+		stats_slow_time = options_get_number(global_options,
+		    "slow-time");
+	}
+	if (stats_slow_time == 0 || us < stats_slow_time * 1000ULL)
+		return (0);
+	return (us);
+}
+
+/* Log something that was slow and add it to the list. */
+void
+stats_slow(enum stats_type type, unsigned long long us, const char *fmt, ...)
+{
+	struct stats_slow	*ss;
+	va_list			 ap;
+
+	ss = xcalloc(1, sizeof *ss);
+	ss->time = time(NULL);
+	ss->type = type;
+	ss->us = us;
+
+	va_start(ap, fmt);
+	xvasprintf(&ss->what, fmt, ap);
+	va_end(ap);
+
+	log_debug("slow %s (%llu us): %s", stats_type_names[type], us,
+	    ss->what);
+
+	TAILQ_INSERT_TAIL(&stats_slow_list, ss, entry);
+	if (++stats_slow_count > STATS_SLOW_LIMIT) {
+		ss = TAILQ_FIRST(&stats_slow_list);
+		TAILQ_REMOVE(&stats_slow_list, ss, entry);
+		free(ss->what);
+		free(ss);
+		stats_slow_count--;
+	}
+}
+
+/* Get name of a type. */
+const char *
+stats_type_name(enum stats_type type)
+{
+	return (stats_type_names[type]);
+}
+
+/* Get number of statistics. */
+u_int
+stats_count(void)
+{
+	return (nitems(stats_table));
+}
+
+/* Get statistic name. */
+const char *
+stats_name(u_int idx)
+{
+	return (stats_table[idx].name);
+}
+
+/* Get statistic value. */
+unsigned long long
+stats_value(u_int idx)
+{
+	return (*(unsigned long long *)((char *)&stats +
+	    stats_table[idx].offset));
+}
+
+/* Find a statistic by name. */
+int
+stats_find(const char *name, unsigned long long *value)
+{
+	u_int	i;
+
+	for (i = 0; i < nitems(stats_table); i++) {
+		if (strcmp(stats_table[i].name, name) == 0) {
+			*value = stats_value(i);
+			return (0);
+		}
+	}
+	return (-1);
+}
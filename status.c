@@ -198,10 +198,11 @@ status_at_line(struct client *c)
 {
 	struct session	*s = c->session;
 
-	if (!options_get_number(s->options, "status"))
+	session_update_options(s);
+	if (!s->status)
 		return (-1);
 
-	if (options_get_number(s->options, "status-position") == 0)
+	if (s->status_position == 0)
 		return (0);
 	return (c->tty.sy - 1);
 }
@@ -292,7 +293,8 @@ status_redraw(struct client *c)
 	int			larrow, rarrow;
 
 	/* No status line? */
-	if (c->tty.sy == 0 || !options_get_number(s->options, "status"))
+	session_update_options(s);
+	if (c->tty.sy == 0 || !s->status)
 		return (1);
 	left = right = NULL;
 	larrow = rarrow = 0;
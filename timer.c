@@ -0,0 +1,257 @@
+/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2016 Nicholas Marriott <nicholas.marriott@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "tmux.h"
+
+/*
+ * Coarse timers for housekeeping (the window silence and name timers). There
+ * may be one or more of these for every window and some are reset very often
+ * (the silence timer on every piece of output), so rather than each being a
+ * libevent timer they are kept on a hierarchical timer wheel, where adding,
+ * resetting or removing a timer is only moving it between lists. Timers that
+ * must keep accurate time, such as the status line timer, stay on libevent.
+ *
+ * The wheel has TIMER_LEVELS levels of TIMER_SLOTS slots. Each slot in the
+ * first level is one tick; each slot in a higher level is a whole turn of the
+ * level below. When the level below wraps round, the timers in the next slot
+ * of the higher level are moved down. A single libevent timer wakes the wheel
+ * when the next timer in the first level is due or when it next wraps.
+ *
+ * Timers never fire early but may fire up to two ticks late.
+ */
+
+#define TIMER_TICK 100 /* milliseconds */
+#define TIMER_BITS 6
+#define TIMER_SLOTS (1 << TIMER_BITS)
+#define TIMER_MASK (TIMER_SLOTS - 1)
+#define TIMER_LEVELS 4
+#define TIMER_MAXIMUM ((1ULL << (TIMER_BITS * TIMER_LEVELS)) - 1)
+
+LIST_HEAD(timer_slot, timer);
+static struct timer_slot timer_wheel[TIMER_LEVELS][TIMER_SLOTS];
+
+static uint64_t		timer_now;
+static uint64_t		timer_wake;
+static u_int		timer_count;
+static struct event	timer_event;
+
+static uint64_t	timer_ticks(void);
+static void	timer_insert(struct timer *);
+static void	timer_cascade(void);
+static void	timer_schedule(uint64_t);
+static void	timer_callback(int, short, void *);
+
+/* Get the current time in ticks. */
+static uint64_t
+timer_ticks(void)
+{
+	struct timespec	ts;
+	uint64_t	ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ms = ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+	return (ms / TIMER_TICK);
+}
+
+/* Put a timer into the slot for its expiry time. */
+static void
+timer_insert(struct timer *t)
+{
+	uint64_t	expire = t->expire, delta;
+	u_int		level;
+
+	if (expire < timer_now)
+		expire = timer_now;
+	delta = expire - timer_now;
+
+	for (level = 0; level < TIMER_LEVELS - 1; level++) {
+		if (delta < (1ULL << (TIMER_BITS * (level + 1))))
+			break;
+	}
+	if (delta > TIMER_MAXIMUM)
+		expire = timer_now + TIMER_MAXIMUM;
+
+	t->slot = &timer_wheel[level][(expire >> (TIMER_BITS * level)) &
+	    TIMER_MASK];
+	LIST_INSERT_HEAD(t->slot, t, entry);
+}
+
+/*
+ * Move timers down from higher levels when the level below wraps. Every timer
+ * moved goes to a lower level (or, if beyond the end of the wheel, to a later
+ * slot of the top level), so none is seen twice.
+ */
+static void
+timer_cascade(void)
+{
+	struct timer_slot	*slot;
+	struct timer		*t;
+	u_int			 level;
+
+	for (level = 1; level < TIMER_LEVELS; level++) {
+		if ((timer_now >> (TIMER_BITS * (level - 1))) & TIMER_MASK)
+			break;
+
+		slot = &timer_wheel[level][(timer_now >> (TIMER_BITS * level)) &
+		    TIMER_MASK];
+		while ((t = LIST_FIRST(slot)) != NULL) {
+			LIST_REMOVE(t, entry);
+			timer_insert(t);
+		}
+	}
+}
+
+/* Make sure the wheel is woken no later than the given tick. */
+static void
+timer_schedule(uint64_t wake)
+{
+	struct timeval	tv;
+	uint64_t	now;
+
+	if (timer_wake != 0 && timer_wake <= wake)
+		return;
+	timer_wake = wake;
+
+	now = timer_ticks();
+	timerclear(&tv);
+	if (wake > now) {
+		tv.tv_sec = ((wake - now) * TIMER_TICK) / 1000;
+		tv.tv_usec = (((wake - now) * TIMER_TICK) % 1000) * 1000;
+	}
+
+	if (!event_initialized(&timer_event))
+		evtimer_set(&timer_event, timer_callback, NULL);
+	evtimer_del(&timer_event);
+	evtimer_add(&timer_event, &tv);
+}
+
+/* Wheel callback. Run any timers that have expired. */
+static void
+timer_callback(__unused int fd, __unused short events, __unused void *arg)
+{
+	struct timer_slot	*slot;
+	struct timer		*t;
+	uint64_t		 now, wake;
+
+	timer_wake = 0;
+
+	now = timer_ticks();
+	while (timer_now < now) {
+		if (timer_count == 0) {
+			timer_now = now;
+			break;
+		}
+		timer_now++;
+		timer_cascade();
+
+		slot = &timer_wheel[0][timer_now & TIMER_MASK];
+		while ((t = LIST_FIRST(slot)) != NULL) {
+			LIST_REMOVE(t, entry);
+			t->slot = NULL;
+			timer_count--;
+
+			t->cb(t->data);
+		}
+	}
+	if (timer_count == 0)
+		return;
+
+	/*
+	 * Wake at the next slot with timers in it, or when the first level
+	 * wraps and the next slot of the second level must be moved down.
+	 */
+	for (wake = timer_now + 1; wake & TIMER_MASK; wake++) {
+		if (!LIST_EMPTY(&timer_wheel[0][wake & TIMER_MASK]))
+			break;
+	}
+	timer_schedule(wake);
+}
+
+/* Set timer callback. */
+void
+timer_set(struct timer *t, void (*cb)(void *), void *data)
+{
+	t->cb = cb;
+	t->data = data;
+	t->slot = NULL;
+}
+
+/* Has this timer been set? */
+int
+timer_initialized(struct timer *t)
+{
+	return (t->cb != NULL);
+}
+
+/* Start a timer, removing it first if it is already running. */
+void
+timer_add(struct timer *t, struct timeval *tv)
+{
+	uint64_t	now, ticks, delta;
+
+	timer_del(t);
+
+	ticks = tv->tv_sec * 1000ULL + (tv->tv_usec + 999) / 1000;
+	ticks = (ticks + TIMER_TICK - 1) / TIMER_TICK;
+
+	/*
+	 * The current tick may be nearly over, so count from the start of the
+	 * next one or the timer could fire up to a tick early.
+	 */
+	now = timer_ticks();
+	if (timer_count == 0)
+		timer_now = now;
+	t->expire = now + 1 + ticks;
+
+	timer_insert(t);
+	timer_count++;
+
+	/*
+	 * A timer in the first level needs the wheel awake when it expires;
+	 * one in a higher level needs it awake when the first level wraps.
+	 */
+	delta = t->expire - timer_now;
+	if (delta < TIMER_SLOTS)
+		timer_schedule(t->expire);
+	else
+		timer_schedule((timer_now | TIMER_MASK) + 1);
+}
+
+/* Stop a timer. */
+void
+timer_del(struct timer *t)
+{
+	if (t->slot == NULL)
+		return;
+	LIST_REMOVE(t, entry);
+	t->slot = NULL;
+	timer_count--;
+}
+
+/* Is this timer running? */
+int
+timer_pending(struct timer *t)
+{
+	return (t->slot != NULL);
+}
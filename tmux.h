@@ -92,6 +92,10 @@ struct tmuxproc;
 #define BELL_CURRENT 2
 #define BELL_OTHER 3
 
+/* Pipe pane overflow option values. */
+#define PIPE_OVERFLOW_DROP 0
+#define PIPE_OVERFLOW_BLOCK 1
+
 /* Special key codes. */
 #define KEYC_NONE 0xffff00000000ULL
 #define KEYC_UNKNOWN 0xfffe00000000ULL
@@ -540,10 +544,11 @@ struct mode_key_table {
 #define ALL_MOUSE_MODES (MODE_MOUSE_STANDARD|MODE_MOUSE_BUTTON)
 
 /*
- * A single UTF-8 character. UTF8_SIZE must be big enough to hold at least one
- * combining character as well.
+ * A single UTF-8 character or grapheme cluster. UTF8_SIZE must be big enough
+ * to hold a base character with its combining characters and the longer emoji
+ * zero width joiner sequences.
 */
-#define UTF8_SIZE 9
+#define UTF8_SIZE 32
 struct utf8_data {
 	u_char	data[UTF8_SIZE];
 
@@ -558,6 +563,9 @@ enum utf8_state {
 	UTF8_ERROR
 };
 
+/* UTF-8 character packed for the grid, see utf8.c. */
+typedef u_int utf8_char;
+
 /* Colour flags. */
 #define COLOUR_FLAG_256 0x01000000
 #define COLOUR_FLAG_RGB 0x02000000
@@ -605,6 +613,13 @@ struct grid_cell_entry {
 		} data;
 	};
 } __packed;
+struct grid_extd_entry {
+	utf8_char		data;
+	u_char			attr;
+	u_char			flags;
+	int			fg;
+	int			bg;
+} __packed;
 
 /* Grid line. */
 struct grid_line {
@@ -613,7 +628,7 @@ struct grid_line {
 	struct grid_cell_entry	*celldata;
 
 	u_int			 extdsize;
-	struct grid_cell	*extddata;
+	struct grid_extd_entry	*extddata;
 
 	int			 flags;
 } __packed;
@@ -645,6 +660,7 @@ struct hook {
 /* Option data structures. */
 struct options_entry {
 	const char		*name;
+	int			 idx;
 
 	enum {
 		OPTIONS_STRING,
@@ -660,8 +676,10 @@ struct options_entry {
 };
 
 /* Scheduled job. */
+struct job_environ;
 struct job {
 	enum {
+		JOB_WAITING,
 		JOB_RUNNING,
 		JOB_DEAD,
 		JOB_CLOSED
@@ -674,11 +692,17 @@ struct job {
 	int		 fd;
 	struct bufferevent *event;
 
+	/* Only used until the job is started. */
+	char		*cwd;
+	struct job_environ *env;
+	int		 peerfd;
+
 	void		(*callbackfn)(struct job *);
 	void		(*freefn)(void *);
 	void		*data;
 
 	LIST_ENTRY(job)	 lentry;
+	TAILQ_ENTRY(job) wentry;
 };
 LIST_HEAD(joblist, job);
 
@@ -810,6 +834,9 @@ struct window_pane {
 #define PANE_FOCUSPUSH 0x10
 #define PANE_INPUTOFF 0x20
 #define PANE_CHANGED 0x40
+#define PANE_REFLOW 0x80
+#define PANE_PIPEFULL 0x100
+#define PANE_FOCUSTRACK 0x200
 
 	int		 argc;
 	char	       **argv;
@@ -820,6 +847,11 @@ struct window_pane {
 	char		 tty[TTY_NAME_MAX];
 	int		 status;
 
+	pid_t		 process_pgrp;
+	struct timeval	 process_time;
+	char		*process_name;
+	char		*process_cwd;
+
 	int		 fd;
 	struct bufferevent *event;
 
@@ -827,6 +859,7 @@ struct window_pane {
 
 	u_int		 wmark_size;
 	u_int		 wmark_hits;
+	unsigned long long bytes_read;
 
 	struct input_ctx *ictx;
 
@@ -837,6 +870,12 @@ struct window_pane {
 	int		 pipe_fd;
 	struct bufferevent *pipe_event;
 	size_t		 pipe_off;
+	char		*pipe_path;
+	off_t		 pipe_size;
+	unsigned long long pipe_bytes;
+	unsigned long long pipe_dropped;
+
+	u_int		 captures;
 
 	struct screen	*screen;
 	struct screen	 base;
@@ -858,19 +897,31 @@ struct window_pane {
 
 	TAILQ_ENTRY(window_pane) entry;
 	RB_ENTRY(window_pane) tree_entry;
+	TAILQ_ENTRY(window_pane) reflow_entry;
+	TAILQ_ENTRY(window_pane) focus_entry;
 };
 TAILQ_HEAD(window_panes, window_pane);
 RB_HEAD(window_pane_tree, window_pane);
 
+/* Coarse timer, kept on the timer wheel rather than by libevent. */
+struct timer {
+	void		(*cb)(void *);
+	void		*data;
+
+	uint64_t	 expire;
+	struct timer_slot *slot;
+	LIST_ENTRY(timer) entry;
+};
+
 /* Window structure. */
 struct window {
 	u_int		 id;
 
 	char		*name;
-	struct event	 name_event;
+	struct timer	 name_timer;
 	struct timeval	 name_time;
 
-	struct event	 alerts_timer;
+	struct timer	 alerts_timer;
 
 	struct timeval	 activity_time;
 
@@ -894,16 +945,27 @@ struct window {
 #define WINDOW_ZOOMED 0x1000
 #define WINDOW_FORCEWIDTH 0x2000
 #define WINDOW_FORCEHEIGHT 0x4000
-#define WINDOW_STYLECHANGED 0x8000
 #define WINDOW_ALERTFLAGS (WINDOW_BELL|WINDOW_ACTIVITY|WINDOW_SILENCE)
 
 	int		 alerts_queued;
 	TAILQ_ENTRY(window) alerts_entry;
 
+	int		 dirty_queued;
+	TAILQ_ENTRY(window) dirty_entry;
+
 	struct options	*options;
 
+	u_int		 options_generation;
 	struct grid_cell style;
 	struct grid_cell active_style;
+	struct grid_cell border_style;
+	struct grid_cell active_border_style;
+	int		 pane_status;
+	int		 monitor_activity;
+	u_int		 monitor_silence;
+	u_int		 pipe_limit;
+	int		 pipe_overflow;
+	u_int		 pipe_rotate;
 
 	u_int		 references;
 	TAILQ_HEAD(, winlink) winlinks;
@@ -1002,9 +1064,14 @@ struct session {
 	struct hooks	*hooks;
 	struct options	*options;
 
+	u_int		 options_generation;
+	int		 status;
+	int		 status_position;
+
 #define SESSION_UNATTACHED 0x1	/* not attached to any clients */
 #define SESSION_PASTING 0x2
 #define SESSION_ALERTED 0x4
+#define SESSION_ALERTSTATUS 0x8
 	int		 flags;
 
 	u_int		 attached;
@@ -1061,17 +1128,22 @@ struct mouse_event {
 	u_int		sgr_b;
 };
 
-/* TTY information. */
-struct tty_key {
-	char		 ch;
-	key_code	 key;
-
-	struct tty_key	*left;
-	struct tty_key	*right;
-
-	struct tty_key	*next;
+/*
+ * TTY key state machine. Bytes are mapped to classes (class 0 is any byte not
+ * in a key) and each state has a transition for each class. State 0 is the
+ * start and a transition to 0 means no key matches.
+ */
+struct tty_keys {
+	u_char		 classes[UCHAR_MAX + 1];
+	u_int		 nclasses;
+
+	u_int		 nstates;
+	u_short		*next;
+	key_code	*keys;
+	u_char		*more;
 };
 
+/* TTY information. */
 struct tty_code;
 struct tty_term {
 	char		*name;
@@ -1146,7 +1218,7 @@ struct tty {
 			    struct mouse_event *);
 
 	struct event	 key_timer;
-	struct tty_key	*key_tree;
+	struct tty_keys	*keys;
 };
 #define TTY_TYPES \
 	{ "VT100", "VT101", "VT102", "VT220", "VT320", "VT420", "UNKNOWN" }
@@ -1255,7 +1327,8 @@ enum cmd_retval {
 	CMD_RETURN_ERROR = -1,
 	CMD_RETURN_NORMAL = 0,
 	CMD_RETURN_WAIT,
-	CMD_RETURN_STOP
+	CMD_RETURN_STOP,
+	CMD_RETURN_YIELD
 };
 
 /* Command queue item type. */
@@ -1267,6 +1340,8 @@ enum cmdq_type {
 /* Command queue item. */
 typedef enum cmd_retval (*cmdq_cb) (struct cmdq_item *, void *);
 struct cmdq_item {
+	struct arena		*arena;
+
 	const char		*name;
 	struct cmdq_list	*queue;
 	struct cmdq_item	*next;
@@ -1285,6 +1360,7 @@ struct cmdq_item {
 #define CMDQ_FIRED 0x1
 #define CMDQ_WAITING 0x2
 #define CMDQ_NOHOOKS 0x4
+#define CMDQ_YIELDED 0x8
 
 	struct cmd_list		*cmdlist;
 	struct cmd		*cmd;
@@ -1349,6 +1425,67 @@ struct cmd_entry {
 	enum cmd_retval		 (*exec)(struct cmd *, struct cmdq_item *);
 };
 
+/* Server statistics. */
+enum stats_type {
+	STATS_LOOP,
+	STATS_COMMAND,
+	STATS_CALLBACK,
+	STATS_PANE_READ,
+	STATS_TTY_READ,
+	STATS_MESSAGE,
+	STATS_REDRAW
+};
+#define STATS_TYPES 7
+#define STATS_BUCKETS 6
+struct stats_latency {
+	unsigned long long count;
+	unsigned long long max;
+	unsigned long long time[STATS_BUCKETS];
+};
+struct stats_slow {
+	time_t			 time;
+	enum stats_type		 type;
+	unsigned long long	 us;
+	char			*what;
+
+	TAILQ_ENTRY(stats_slow)	 entry;
+};
+TAILQ_HEAD(stats_slow_list, stats_slow);
+struct stats {
+	unsigned long long pane_bytes;
+	unsigned long long client_bytes;
+	unsigned long long pipe_bytes;
+	unsigned long long pipe_dropped;
+	unsigned long long cells;
+	unsigned long long tty_commands;
+
+	unsigned long long redraw_full;
+	unsigned long long redraw_window;
+	unsigned long long redraw_pane;
+	unsigned long long redraw_status;
+	unsigned long long redraw_borders;
+
+	unsigned long long formats;
+	unsigned long long jobs;
+
+	struct stats_latency latency[STATS_TYPES];
+};
+
+/* Trace events. */
+enum trace_event {
+	TRACE_TIME,
+	TRACE_PROC_RECV,
+	TRACE_PROC_SEND,
+	TRACE_INPUT,
+	TRACE_SCREEN_WRITE,
+	TRACE_TTY_COMMAND,
+	TRACE_TTY_DRAW_LINE,
+	TRACE_CMDQ_FIRE,
+	TRACE_CMDQ_DONE,
+	TRACE_CLIENT_KEY,
+	TRACE_CLIENT_REDRAW
+};
+
 /* Client connection. */
 struct client {
 	struct tmuxpeer	*peer;
@@ -1370,6 +1507,7 @@ struct client {
 	char		*term;
 	char		*ttyname;
 	struct tty	 tty;
+	unsigned long long bytes_written;
 
 	void		(*stdin_callback)(struct client *, int, void *);
 	void		*stdin_callback_data;
@@ -1408,6 +1546,7 @@ struct client {
 #define CLIENT_STATUSFORCE 0x80000
 #define CLIENT_DOUBLECLICK 0x100000
 #define CLIENT_TRIPLECLICK 0x200000
+#define CLIENT_ALERTBELL 0x400000
 	int		 flags;
 	struct key_table *keytable;
 
@@ -1415,6 +1554,8 @@ struct client {
 	void		(*identify_callback)(struct client *, struct window_pane *);
 	void		*identify_callback_data;
 
+	char		*alerts_message;
+
 	char		*message_string;
 	struct event	 message_timer;
 	u_int		 message_next;
@@ -1529,6 +1670,7 @@ const char	*find_home(void);
 struct imsg;
 int	proc_send(struct tmuxpeer *, enum msgtype, int, const void *, size_t);
 int	proc_send_s(struct tmuxpeer *, enum msgtype, const char *);
+u_int	proc_queued(struct tmuxpeer *);
 struct tmuxproc *proc_start(const char *, struct event_base *, int,
 	    void (*)(int));
 void	proc_loop(struct tmuxproc *, int (*)(void));
@@ -1613,7 +1755,7 @@ void	mode_key_init(struct mode_key_data *, struct mode_key_tree *);
 enum mode_key_cmd mode_key_lookup(struct mode_key_data *, key_code);
 
 /* notify.c */
-void	notify_input(struct window_pane *, struct evbuffer *);
+void	notify_input(struct window_pane *, const u_char *, size_t);
 void	notify_client(const char *, struct client *);
 void	notify_session(const char *, struct session *);
 void	notify_winlink(const char *, struct session *, struct winlink *);
@@ -1622,6 +1764,7 @@ void	notify_window(const char *, struct window *);
 void	notify_pane(const char *, struct window_pane *);
 
 /* options.c */
+extern u_int options_generation;
 struct options *options_create(struct options *);
 void	options_free(struct options *);
 struct options_entry *options_first(struct options *);
@@ -1645,6 +1788,8 @@ void	options_table_populate_tree(enum options_table_scope, struct options *);
 const char *options_table_print_entry(const struct options_table_entry *,
 	    struct options_entry *, int);
 int	options_table_find(const char *, const struct options_table_entry **);
+u_int	options_table_count(void);
+int	options_table_index(const char *);
 
 /* job.c */
 extern struct joblist all_jobs;
@@ -1653,6 +1798,25 @@ struct job *job_run(const char *, struct session *, const char *,
 void	job_free(struct job *);
 void	job_died(struct job *, int);
 
+/* replay.c */
+struct replay;
+struct replay	*replay_create(u_int, u_int, u_int, const char *, char **);
+void		 replay_free(struct replay *);
+struct window_pane *replay_pane(struct replay *);
+size_t		 replay_written(struct replay *, u_int);
+void		 replay_set_file(struct replay *, u_int, FILE *);
+u_int		 replay_checksum(struct replay *);
+void		 replay_input(struct replay *, const void *, size_t);
+void		 replay_redraw(struct replay *);
+char		*replay_get_path(struct client *, const char *);
+char		*replay_read_file(struct client *, const char *, size_t *,
+		     char **);
+
+/* spawn.c */
+void	spawn_helper_start(void);
+pid_t	spawn_helper_pane(struct window_pane *, const char *, struct environ *,
+	    struct termios *, struct winsize *);
+
 /* environ.c */
 struct environ *environ_create(void);
 void	environ_free(struct environ *);
@@ -1667,8 +1831,26 @@ void	environ_put(struct environ *, const char *);
 void	environ_unset(struct environ *, const char *);
 void	environ_update(const char *, struct environ *, struct environ *);
 void	environ_push(struct environ *);
+u_int	environ_generation(struct environ *);
+char  **environ_array(struct environ *);
+void	environ_free_array(char **);
 void	environ_log(struct environ *, const char *);
 
+/* timer.c */
+void		 timer_set(struct timer *, void (*)(void *), void *);
+int		 timer_initialized(struct timer *);
+void		 timer_add(struct timer *, struct timeval *);
+void		 timer_del(struct timer *);
+int		 timer_pending(struct timer *);
+
+/* trace.c */
+void		 trace_start(void);
+void		 trace_add(enum trace_event, u_int, u_int, u_int);
+u_int		 trace_count(void);
+char		*trace_describe(u_int);
+int		 trace_save(const char *);
+void		 trace_fatal(void);
+
 /* tty.c */
 void	tty_create_log(void);
 void	tty_raw(struct tty *, const char *);
@@ -1819,6 +2001,9 @@ void		 cmdq_append(struct client *, struct cmdq_item *);
 void printflike(3, 4) cmdq_format(struct cmdq_item *, const char *,
 		     const char *, ...);
 u_int		 cmdq_next(struct client *);
+void		 cmdq_slice_start(void);
+int		 cmdq_slice_expired(void);
+int		 cmdq_ready(void);
 void		 cmdq_guard(struct cmdq_item *, const char *, int);
 void printflike(2, 3) cmdq_print(struct cmdq_item *, const char *, ...);
 void printflike(2, 3) cmdq_error(struct cmdq_item *, const char *, ...);
@@ -1855,6 +2040,7 @@ const char	*key_string_lookup_key(key_code);
 /* alerts.c */
 void	alerts_reset_all(void);
 void	alerts_queue(struct window *, int);
+void	alerts_dequeue(struct window *);
 void	alerts_check_session(struct session *);
 
 /* server.c */
@@ -1870,6 +2056,7 @@ int	 server_check_marked(void);
 int	 server_start(struct event_base *, int, char *);
 void	 server_update_socket(void);
 void	 server_add_accept(int);
+void	 server_child_status(pid_t, int);
 
 /* server-client.c */
 void	 server_client_set_key_table(struct client *, const char *);
@@ -1878,6 +2065,9 @@ int	 server_client_is_default_key_table(struct client *);
 int	 server_client_check_nested(struct client *);
 void	 server_client_handle_key(struct client *, key_code);
 void	 server_client_create(int);
+const char *server_client_name(struct client *);
+void	 server_client_track_focus(struct window_pane *);
+void	 server_client_untrack_focus(struct window_pane *);
 int	 server_client_open(struct client *, char **);
 void	 server_client_unref(struct client *);
 void	 server_client_lost(struct client *);
@@ -1913,6 +2103,18 @@ int	 server_set_stdin_callback(struct client *, void (*)(struct client *,
 	     int, void *), void *, char **);
 void	 server_unzoom_window(struct window *);
 
+/* stats.c */
+extern struct stats stats;
+extern struct stats_slow_list stats_slow_list;
+unsigned long long stats_time(enum stats_type, struct timeval *);
+void printflike(3, 4) stats_slow(enum stats_type, unsigned long long,
+		     const char *, ...);
+const char	*stats_type_name(enum stats_type);
+u_int		 stats_count(void);
+const char	*stats_name(u_int);
+unsigned long long stats_value(u_int);
+int		 stats_find(const char *, unsigned long long *);
+
 /* status.c */
 void	 status_timer_start(struct client *);
 void	 status_timer_start_all(void);
@@ -1940,6 +2142,7 @@ void	 input_free(struct window_pane *);
 void	 input_reset(struct window_pane *, int);
 struct evbuffer *input_pending(struct window_pane *);
 void	 input_parse(struct window_pane *);
+void	 input_parse_buffer(struct window_pane *, const u_char *, size_t);
 
 /* input-key.c */
 void	 input_key(struct window_pane *, key_code, struct mouse_event *);
@@ -2080,6 +2283,7 @@ int		 winlink_cmp(struct winlink *, struct winlink *);
 RB_PROTOTYPE(winlinks, winlink, entry, winlink_cmp);
 int		 window_pane_cmp(struct window_pane *, struct window_pane *);
 RB_PROTOTYPE(window_pane_tree, window_pane, tree_entry, window_pane_cmp);
+void		 window_update_options(struct window *);
 struct winlink	*winlink_find_by_index(struct winlinks *, int);
 struct winlink	*winlink_find_by_window(struct winlinks *, struct window *);
 struct winlink	*winlink_find_by_window_id(struct winlinks *, u_int);
@@ -2129,6 +2333,18 @@ int		 window_pane_spawn(struct window_pane *, int, char **,
 		     const char *, const char *, const char *, struct environ *,
 		     struct termios *, char **);
 void		 window_pane_resize(struct window_pane *, u_int, u_int);
+void		 window_pane_reflow(struct window_pane *);
+void		 window_pane_reflow_all(void);
+void		 window_dirty(struct window *, int);
+void		 window_pane_dirty(struct window_pane *, int);
+struct window	*window_next_dirty(void);
+void		 window_pane_process_reset(void);
+const char	*window_pane_process_name(struct window_pane *, int);
+const char	*window_pane_process_cwd(struct window_pane *, int);
+int		 window_pane_pipe_file(struct window_pane *, const char *);
+void		 window_pane_pipe_close(struct window_pane *);
+void		 window_pane_pipe_unblock(struct window_pane *);
+void		 window_pane_read_resume(struct window_pane *);
 void		 window_pane_alternate_on(struct window_pane *,
 		     struct grid_cell *, int);
 void		 window_pane_alternate_off(struct window_pane *,
@@ -2241,7 +2457,7 @@ void	control_write_buffer(struct client *, struct evbuffer *);
 
 /* control-notify.c */
 void	control_notify_input(struct client *, struct window_pane *,
-	    struct evbuffer *);
+	    const u_char *, size_t);
 void	control_notify_window_layout_changed(struct window *);
 void	control_notify_window_unlinked(struct session *, struct window *);
 void	control_notify_window_linked(struct session *, struct window *);
@@ -2267,6 +2483,7 @@ void		 session_destroy(struct session *);
 void		 session_unref(struct session *);
 int		 session_check_name(const char *);
 void		 session_update_activity(struct session *, struct timeval *);
+void		 session_update_options(struct session *);
 struct session	*session_next_session(struct session *);
 struct session	*session_previous_session(struct session *);
 struct winlink	*session_new(struct session *, const char *, int, char **,
@@ -2295,6 +2512,10 @@ enum utf8_state	 utf8_open(struct utf8_data *, u_char);
 enum utf8_state	 utf8_append(struct utf8_data *, u_char);
 enum utf8_state	 utf8_combine(const struct utf8_data *, wchar_t *);
 enum utf8_state	 utf8_split(wchar_t, struct utf8_data *);
+enum utf8_state	 utf8_from_data(const struct utf8_data *, utf8_char *);
+void		 utf8_to_data(utf8_char, struct utf8_data *);
+int		 utf8_in_cluster(const struct utf8_data *,
+		     const struct utf8_data *);
 int		 utf8_strvis(char *, const char *, size_t, int);
 char		*utf8_sanitize(const char *);
 size_t		 utf8_strlen(const struct utf8_data *);
@@ -0,0 +1,39 @@
+#!/usr/bin/perl
+# Decode a tmux trace saved with show-trace -o or after a fatal error.
+#
+# Usage: decode-trace.pl tmux-trace-PID.bin
+
+use strict;
+use warnings;
+use POSIX qw(strftime);
+
+my $file = shift or die "usage: $0 file\n";
+open(my $fh, "<:raw", $file) or die "$file: $!\n";
+
+my $header = <$fh>;
+die "$file: not a tmux trace\n" unless defined $header and
+    $header eq "tmux trace 1\n";
+
+my (%names, %args);
+while (my $line = <$fh>) {
+	chomp $line;
+	last if $line eq "";
+	my ($number, $name, @labels) = split(/ /, $line);
+	$names{$number} = $name;
+	$args{$number} = [ @labels ];
+}
+
+my $entry;
+while (read($fh, $entry, 24) == 24) {
+	my ($time, $event, @values) = unpack("Q L L L L", $entry);
+	my $name = $names{$event} // "unknown-$event";
+	my $out = sprintf("%s.%06u %s",
+	    strftime("%H:%M:%S", localtime(int($time / 1000000))),
+	    $time % 1000000, $name);
+	my @labels = @{ $args{$event} // [] };
+	for my $i (0 .. $#labels) {
+		$out .= " $labels[$i]=$values[$i]";
+	}
+	print "$out\n";
+}
+close($fh);
@@ -0,0 +1,197 @@
+/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2016 Nicholas Marriott <nicholas.marriott@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tmux.h"
+
+/*
+ * Trace ring. The server records a small binary entry (the time, an event and
+ * up to three numbers) at interesting points. Adding an entry is a clock read
+ * and a store into a fixed ring with no formatting and no locking (the server
+ * has only one thread), so tracing is always on. The ring is shown with
+ * show-trace, written to a file with show-trace -o, and written to
+ * tmux-trace-PID.bin if the server dies with fatal() or fatalx(). Saved files
+ * are turned back into text by tools/decode-trace.pl.
+ *
+ * A saved file is a text header ("tmux trace 1", then a line for each event
+ * with its number, name and the names of its arguments, then an empty line)
+ * followed by the entries as struct trace_entry in native byte order, oldest
+ * first.
+ */
+
+#define TRACE_SIZE 16384
+
+struct trace_entry {
+	uint64_t	time;
+	u_int		event;
+	u_int		args[3];
+};
+
+static const struct {
+	const char	*name;
+	const char	*args[3];
+} trace_table[] = {
+	[TRACE_TIME] = { "time", { "type", "us" } },
+	[TRACE_PROC_RECV] = { "proc-recv", { "type", "bytes" } },
+	[TRACE_PROC_SEND] = { "proc-send", { "type", "bytes" } },
+	[TRACE_INPUT] = { "input", { "pane", "bytes" } },
+	[TRACE_SCREEN_WRITE] = { "screen-write",
+	    { "cells", "written", "skipped" } },
+	[TRACE_TTY_COMMAND] = { "tty-command", { "pane", "clients" } },
+	[TRACE_TTY_DRAW_LINE] = { "tty-draw-line", { "pane", "line" } },
+	[TRACE_CMDQ_FIRE] = { "cmdq-fire", { "item", "type" } },
+	[TRACE_CMDQ_DONE] = { "cmdq-done", { "item", "result" } },
+	[TRACE_CLIENT_KEY] = { "client-key", { "pid", "key", "high" } },
+	[TRACE_CLIENT_REDRAW] = { "client-redraw", { "pid", "flags" } },
+};
+
+static struct trace_entry	*trace_ring;
+static u_int			 trace_next;
+static int			 trace_wrapped;
+
+static void	trace_write(FILE *);
+
+/* Start tracing. Only the server traces. */
+void
+trace_start(void)
+{
+	if (trace_ring == NULL)
+		trace_ring = xcalloc(TRACE_SIZE, sizeof *trace_ring);
+}
+
+/* Add a trace entry. */
+void
+trace_add(enum trace_event event, u_int arg0, u_int arg1, u_int arg2)
+{
+	struct trace_entry	*te;
+	struct timeval		 tv;
+
+	if (trace_ring == NULL)
+		return;
+
+	gettimeofday(&tv, NULL);
+
+	te = &trace_ring[trace_next];
+	te->time = tv.tv_sec * 1000000ULL + tv.tv_usec;
+	te->event = event;
+	te->args[0] = arg0;
+	te->args[1] = arg1;
+	te->args[2] = arg2;
+
+	if (++trace_next == TRACE_SIZE) {
+		trace_next = 0;
+		trace_wrapped = 1;
+	}
+}
+
+/* Get number of entries in the ring. */
+u_int
+trace_count(void)
+{
+	if (trace_wrapped)
+		return (TRACE_SIZE);
+	return (trace_next);
+}
+
+/* Describe entry, oldest first. Caller frees. */
+char *
+trace_describe(u_int idx)
+{
+	struct trace_entry	*te;
+	const char		*name;
+	char			*s;
+	size_t			 off;
+	time_t			 t;
+	u_int			 i;
+
+	if (trace_wrapped)
+		idx = (trace_next + idx) % TRACE_SIZE;
+	te = &trace_ring[idx];
+
+	s = xmalloc(256);
+	t = te->time / 1000000;
+	off = strftime(s, 256, "%H:%M:%S", localtime(&t));
+	off += xsnprintf(s + off, 256 - off, ".%06u %s",
+	    (u_int)(te->time % 1000000), trace_table[te->event].name);
+	for (i = 0; i < nitems(te->args); i++) {
+		if ((name = trace_table[te->event].args[i]) == NULL)
+			break;
+		off += xsnprintf(s + off, 256 - off, " %s=%u", name,
+		    te->args[i]);
+	}
+	return (s);
+}
+
+/* Write the trace to a file. */
+static void
+trace_write(FILE *f)
+{
+	u_int	i, j;
+
+	fprintf(f, "tmux trace 1\n");
+	for (i = 0; i < nitems(trace_table); i++) {
+		fprintf(f, "%u %s", i, trace_table[i].name);
+		for (j = 0; j < nitems(trace_table[i].args); j++) {
+			if (trace_table[i].args[j] != NULL)
+				fprintf(f, " %s", trace_table[i].args[j]);
+		}
+		fprintf(f, "\n");
+	}
+	fprintf(f, "\n");
+
+	if (trace_wrapped) {
+		fwrite(trace_ring + trace_next, sizeof *trace_ring,
+		    TRACE_SIZE - trace_next, f);
+	}
+	fwrite(trace_ring, sizeof *trace_ring, trace_next, f);
+}
+
+/* Save the trace to a file. */
+int
+trace_save(const char *path)
+{
+	FILE	*f;
+
+	if ((f = fopen(path, "wb")) == NULL)
+		return (-1);
+	trace_write(f);
+	if (ferror(f)) {
+		fclose(f);
+		return (-1);
+	}
+	return (fclose(f));
+}
+
+/* Save the trace before dying. */
+void
+trace_fatal(void)
+{
+	char	path[64];
+
+	if (trace_ring == NULL || trace_count() == 0)
+		return;
+	snprintf(path, sizeof path, "tmux-trace-%ld.bin", (long)getpid());
+	trace_save(path);
+}
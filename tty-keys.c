@@ -30,20 +30,17 @@
 /*
  * Handle keys input from the outside terminal. tty_default_*_keys[] are a base
  * table of supported keys which are looked up in terminfo(5) and translated
- * into a ternary tree.
+ * into a state machine with one transition for each byte of a key.
  */
 
-static void	tty_keys_add1(struct tty_key **, const char *, key_code);
-static void	tty_keys_add(struct tty *, const char *, key_code);
-static void	tty_keys_free1(struct tty_key *);
-static struct tty_key *tty_keys_find1(struct tty_key *, const char *, size_t,
-		    size_t *);
-static struct tty_key *tty_keys_find(struct tty *, const char *, size_t,
-		    size_t *);
+static void	tty_keys_add(struct tty_keys *, const char *, key_code);
+static u_int	tty_keys_find(struct tty *, const char *, size_t, size_t *);
 static int	tty_keys_next1(struct tty *, const char *, size_t, key_code *,
 		    size_t *, int);
 static void	tty_keys_callback(int, short, void *);
 static int	tty_keys_mouse(struct tty *, const char *, size_t, size_t *);
+static struct window_pane *tty_keys_mouse_pane(struct tty *, u_int, u_int);
+static int	tty_keys_mouse_coalesce(struct tty *, const char *, size_t);
 static int	tty_keys_device_attributes(struct tty *, const char *, size_t,
 		    size_t *);
 
@@ -320,149 +317,146 @@ static const struct tty_default_key_code tty_default_code_keys[] = {
 	{ TTYC_KUP7, KEYC_UP|KEYC_ESCAPE|KEYC_CTRL },
 };
 
-/* Add key to tree. */
-static void
-tty_keys_add(struct tty *tty, const char *s, key_code key)
-{
-	struct tty_key	*tk;
-	size_t		 size;
-	const char     	*keystr;
-
-	keystr = key_string_lookup_key(key);
-	if ((tk = tty_keys_find(tty, s, strlen(s), &size)) == NULL) {
-		log_debug("new key %s: 0x%llx (%s)", s, key, keystr);
-		tty_keys_add1(&tty->key_tree, s, key);
-	} else {
-		log_debug("replacing key %s: 0x%llx (%s)", s, key, keystr);
-		tk->key = key;
-	}
-}
-
-/* Add next node to the tree. */
+/* Add key to the state machine. */
 static void
-tty_keys_add1(struct tty_key **tkp, const char *s, key_code key)
+tty_keys_add(struct tty_keys *tk, const char *s, key_code key)
 {
-	struct tty_key	*tk;
-
-	/* Allocate a tree entry if there isn't one already. */
-	tk = *tkp;
-	if (tk == NULL) {
-		tk = *tkp = xcalloc(1, sizeof *tk);
-		tk->ch = *s;
-		tk->key = KEYC_UNKNOWN;
-	}
-
-	/* Find the next entry. */
-	if (*s == tk->ch) {
-		/* Move forward in string. */
-		s++;
-
-		/* If this is the end of the string, no more is necessary. */
-		if (*s == '\0') {
-			tk->key = key;
-			return;
+	const char	*keystr = key_string_lookup_key(key);
+	const char	*cp;
+	u_short		*next;
+	u_int		 state;
+
+	state = 0;
+	for (cp = s; *cp != '\0'; cp++) {
+		next = &tk->next[state * tk->nclasses + tk->classes[(u_char)*cp]];
+		if (*next == 0) {
+			*next = tk->nstates++;
+			tk->keys[*next] = KEYC_UNKNOWN;
+			tk->more[state] = 1;
 		}
-
-		/* Use the child tree for the next character. */
-		tkp = &tk->next;
-	} else {
-		if (*s < tk->ch)
-			tkp = &tk->left;
-		else if (*s > tk->ch)
-			tkp = &tk->right;
+		state = *next;
 	}
 
-	/* And recurse to add it. */
-	tty_keys_add1(tkp, s, key);
+	if (tk->keys[state] == KEYC_UNKNOWN)
+		log_debug("new key %s: 0x%llx (%s)", s, key, keystr);
+	else
+		log_debug("replacing key %s: 0x%llx (%s)", s, key, keystr);
+	tk->keys[state] = key;
 }
 
-/* Initialise a key tree from the table. */
+/* Build the key state machine from the tables. */
 void
 tty_keys_build(struct tty *tty)
 {
 	const struct tty_default_key_raw	*tdkr;
 	const struct tty_default_key_code	*tdkc;
-	u_int		 			 i;
-	const char				*s;
+	struct tty_keys				*tk;
+	const char				**strings, *s;
+	key_code				*keys;
+	u_int		 			 i, n, total;
 
-	if (tty->key_tree != NULL)
+	if (tty->keys != NULL)
 		tty_keys_free(tty);
-	tty->key_tree = NULL;
 
+	n = nitems(tty_default_raw_keys) + nitems(tty_default_code_keys);
+	strings = xreallocarray(NULL, n, sizeof *strings);
+	keys = xreallocarray(NULL, n, sizeof *keys);
+
+	n = 0;
 	for (i = 0; i < nitems(tty_default_raw_keys); i++) {
 		tdkr = &tty_default_raw_keys[i];
 
 		s = tdkr->string;
-		if (*s != '\0')
-			tty_keys_add(tty, s, tdkr->key);
+		if (*s != '\0') {
+			strings[n] = s;
+			keys[n++] = tdkr->key;
+		}
 	}
 	for (i = 0; i < nitems(tty_default_code_keys); i++) {
 		tdkc = &tty_default_code_keys[i];
 
 		s = tty_term_string(tty->term, tdkc->code);
-		if (*s != '\0')
-			tty_keys_add(tty, s, tdkc->key);
+		if (*s != '\0') {
+			strings[n] = s;
+			keys[n++] = tdkc->key;
+		}
+	}
 
+	/*
+	 * Give each byte used in any key its own class and work out the most
+	 * states that could be needed.
+	 */
+	tk = tty->keys = xcalloc(1, sizeof *tk);
+	tk->nclasses = 1;
+	total = 1;
+	for (i = 0; i < n; i++) {
+		for (s = strings[i]; *s != '\0'; s++) {
+			if (tk->classes[(u_char)*s] == 0)
+				tk->classes[(u_char)*s] = tk->nclasses++;
+			total++;
+		}
 	}
+	if (total > USHRT_MAX)
+		fatalx("too many keys");
+
+	tk->next = xcalloc(total, tk->nclasses * sizeof *tk->next);
+	tk->keys = xcalloc(total, sizeof *tk->keys);
+	tk->more = xcalloc(total, sizeof *tk->more);
+	tk->keys[0] = KEYC_UNKNOWN;
+	tk->nstates = 1;
+
+	for (i = 0; i < n; i++)
+		tty_keys_add(tk, strings[i], keys[i]);
+
+	tk->next = xreallocarray(tk->next, tk->nstates,
+	    tk->nclasses * sizeof *tk->next);
+	tk->keys = xreallocarray(tk->keys, tk->nstates, sizeof *tk->keys);
+	tk->more = xreallocarray(tk->more, tk->nstates, sizeof *tk->more);
+	log_debug("%s: %u keys, %u states, %u classes", __func__, n,
+	    tk->nstates, tk->nclasses);
+
+	free(strings);
+	free(keys);
 }
 
-/* Free the entire key tree. */
+/* Free the key state machine. */
 void
 tty_keys_free(struct tty *tty)
 {
-	tty_keys_free1(tty->key_tree);
-}
+	struct tty_keys	*tk = tty->keys;
 
-/* Free a single key. */
-static void
-tty_keys_free1(struct tty_key *tk)
-{
-	if (tk->next != NULL)
-		tty_keys_free1(tk->next);
-	if (tk->left != NULL)
-		tty_keys_free1(tk->left);
-	if (tk->right != NULL)
-		tty_keys_free1(tk->right);
+	if (tk == NULL)
+		return;
+	free(tk->next);
+	free(tk->keys);
+	free(tk->more);
 	free(tk);
+	tty->keys = NULL;
 }
 
-/* Lookup a key in the tree. */
-static struct tty_key *
+/*
+ * Look up a key. Stops at the end of the buffer or at a key which cannot be
+ * continued, and returns the state or 0 if nothing matches.
+ */
+static u_int
 tty_keys_find(struct tty *tty, const char *buf, size_t len, size_t *size)
 {
-	*size = 0;
-	return (tty_keys_find1(tty->key_tree, buf, len, size));
-}
-
-/* Find the next node. */
-static struct tty_key *
-tty_keys_find1(struct tty_key *tk, const char *buf, size_t len, size_t *size)
-{
-	/* If the node is NULL, this is the end of the tree. No match. */
-	if (tk == NULL)
-		return (NULL);
+	struct tty_keys	*tk = tty->keys;
+	u_int		 state = 0;
 
-	/* Pick the next in the sequence. */
-	if (tk->ch == *buf) {
-		/* Move forward in the string. */
+	*size = 0;
+	while (len != 0) {
+		state = tk->next[state * tk->nclasses +
+		    tk->classes[(u_char)*buf]];
+		if (state == 0)
+			return (0);
 		buf++; len--;
 		(*size)++;
 
-		/* At the end of the string, return the current node. */
-		if (len == 0 || (tk->next == NULL && tk->key != KEYC_UNKNOWN))
-			return (tk);
-
-		/* Move into the next tree for the following character. */
-		tk = tk->next;
-	} else {
-		if (*buf < tk->ch)
-			tk = tk->left;
-		else if (*buf > tk->ch)
-			tk = tk->right;
+		if (!tk->more[state] && tk->keys[state] != KEYC_UNKNOWN)
+			break;
 	}
-
-	/* Move to the next in the tree. */
-	return (tty_keys_find1(tk, buf, len, size));
+	return (state);
 }
 
 /* Look up part of the next key. */
@@ -470,25 +464,21 @@ static int
 tty_keys_next1(struct tty *tty, const char *buf, size_t len, key_code *key,
     size_t *size, int expired)
 {
-	struct tty_key		*tk, *tk1;
+	struct tty_keys		*tk = tty->keys;
 	struct utf8_data	 ud;
 	enum utf8_state		 more;
-	u_int			 i;
+	u_int			 i, state;
 	wchar_t			 wc;
 
 	log_debug("next key is %zu (%.*s) (expired=%d)", len, (int)len, buf,
 	    expired);
 
 	/* Is this a known key? */
-	tk = tty_keys_find(tty, buf, len, size);
-	if (tk != NULL && tk->key != KEYC_UNKNOWN) {
-		tk1 = tk;
-		do
-			log_debug("keys in list: %#llx", tk1->key);
-		while ((tk1 = tk1->next) != NULL);
-		if (tk->next != NULL && !expired)
+	state = tty_keys_find(tty, buf, len, size);
+	if (state != 0 && tk->keys[state] != KEYC_UNKNOWN) {
+		if (tk->more[state] && !expired)
 			return (1);
-		*key = tk->key;
+		*key = tk->keys[state];
 		return (0);
 	}
 
@@ -554,6 +544,16 @@ tty_keys_next(struct tty *tty)
 	switch (tty_keys_mouse(tty, buf, len, &size)) {
 	case 0:		/* yes */
 		key = KEYC_MOUSE;
+		if (tty_keys_mouse_coalesce(tty, buf + size, len - size)) {
+			/*
+			 * Forget this event so the next one is relative to
+			 * the last that was used.
+			 */
+			tty->mouse.x = tty->mouse.lx;
+			tty->mouse.y = tty->mouse.ly;
+			tty->mouse.b = tty->mouse.lb;
+			goto discard_key;
+		}
 		goto complete_key;
 	case -1:	/* no, or not valid */
 		break;
@@ -688,6 +688,55 @@ tty_keys_callback(__unused int fd, __unused short events, void *data)
 	}
 }
 
+/* Get the pane under a mouse position, NULL if none or the status line. */
+static struct window_pane *
+tty_keys_mouse_pane(struct tty *tty, u_int x, u_int y)
+{
+	struct client	*c = tty->client;
+	int		 at;
+
+	if (c->session == NULL)
+		return (NULL);
+
+	at = status_at_line(c);
+	if (at != -1 && y == (u_int)at)
+		return (NULL);
+	if (at == 0)
+		y--;
+	return (window_get_active_at(c->session->curw->window, x, y));
+}
+
+/*
+ * Check if a mouse motion event is followed in the buffer by another with the
+ * same buttons over the same pane, in which case only the last is needed.
+ * Presses and releases are never coalesced.
+ */
+static int
+tty_keys_mouse_coalesce(struct tty *tty, const char *buf, size_t len)
+{
+	struct mouse_event	*m = &tty->mouse, saved;
+	size_t			 size;
+	int			 same;
+
+	if (len == 0 || !MOUSE_DRAG(m->b))
+		return (0);
+
+	memcpy(&saved, m, sizeof saved);
+	if (tty_keys_mouse(tty, buf, len, &size) != 0) {
+		memcpy(m, &saved, sizeof *m);
+		return (0);
+	}
+	same = (m->b == saved.b &&
+	    m->sgr_type == saved.sgr_type &&
+	    tty_keys_mouse_pane(tty, m->x, m->y) ==
+	    tty_keys_mouse_pane(tty, saved.x, saved.y));
+	memcpy(m, &saved, sizeof *m);
+
+	if (same)
+		log_debug("coalescing mouse %u,%u", m->x, m->y);
+	return (same);
+}
+
 /*
  * Handle mouse key input. Returns 0 for success, -1 for failure, 1 for partial
  * (probably a mouse sequence but need more data).
@@ -40,6 +40,7 @@ static void	tty_read_callback(struct bufferevent *, void *);
 static void	tty_error_callback(struct bufferevent *, short, void *);
 
 static int	tty_client_ready(struct client *, struct window_pane *);
+static void	tty_add(struct tty *, const void *, size_t);
 
 static void	tty_set_italics(struct tty *);
 static int	tty_try_colour(struct tty *, int, const char *);
@@ -199,10 +200,17 @@ tty_open(struct tty *tty, char **cause)
 static void
 tty_read_callback(__unused struct bufferevent *bufev, void *data)
 {
-	struct tty	*tty = data;
+	struct tty		*tty = data;
+	struct timeval		 start;
+	unsigned long long	 us;
 
+	gettimeofday(&start, NULL);
 	while (tty_keys_next(tty))
 		;
+	if ((us = stats_time(STATS_TTY_READ, &start)) != 0) {
+		stats_slow(STATS_TTY_READ, us, "client %s",
+		    server_client_name(tty->client));
+	}
 }
 
 static void
@@ -433,12 +441,21 @@ tty_putcode_ptr2(struct tty *tty, enum tty_code_code code, const void *a,
 		tty_puts(tty, tty_term_ptr2(tty->term, code, a, b));
 }
 
+static void
+tty_add(struct tty *tty, const void *buf, size_t len)
+{
+	bufferevent_write(tty->event, buf, len);
+
+	tty->client->bytes_written += len;
+	stats.client_bytes += len;
+}
+
 void
 tty_puts(struct tty *tty, const char *s)
 {
 	if (*s == '\0')
 		return;
-	bufferevent_write(tty->event, s, strlen(s));
+	tty_add(tty, s, strlen(s));
 
 	if (tty_log_fd != -1)
 		write(tty_log_fd, s, strlen(s));
@@ -452,11 +469,11 @@ tty_putc(struct tty *tty, u_char ch)
 	if (tty->cell.attr & GRID_ATTR_CHARSET) {
 		acs = tty_acs_get(tty, ch);
 		if (acs != NULL)
-			bufferevent_write(tty->event, acs, strlen(acs));
+			tty_add(tty, acs, strlen(acs));
 		else
-			bufferevent_write(tty->event, &ch, 1);
+			tty_add(tty, &ch, 1);
 	} else
-		bufferevent_write(tty->event, &ch, 1);
+		tty_add(tty, &ch, 1);
 
 	if (ch >= 0x20 && ch != 0x7f) {
 		if (tty->cx >= tty->sx) {
@@ -482,7 +499,7 @@ tty_putc(struct tty *tty, u_char ch)
 void
 tty_putn(struct tty *tty, const void *buf, size_t len, u_int width)
 {
-	bufferevent_write(tty->event, buf, len);
+	tty_add(tty, buf, len);
 	if (tty_log_fd != -1)
 		write(tty_log_fd, buf, len);
 	tty->cx += width;
@@ -665,7 +682,7 @@ tty_redraw_region(struct tty *tty, const struct tty_ctx *ctx)
 	 * likely to be followed by some more scrolling.
 	 */
 	if (tty_large_region(tty, ctx)) {
-		wp->flags |= PANE_REDRAW;
+		window_pane_dirty(wp, PANE_REDRAW);
 		return;
 	}
 
@@ -694,6 +711,8 @@ tty_draw_line(struct tty *tty, const struct window_pane *wp,
 	u_int			 i, sx;
 	int			 flags;
 
+	trace_add(TRACE_TTY_DRAW_LINE, wp == NULL ? (u_int)-1 : wp->id, py, 0);
+
 	flags = tty->flags & TTY_NOCURSOR;
 	tty->flags |= TTY_NOCURSOR;
 	tty_update_mode(tty, tty->mode, s);
@@ -765,6 +784,7 @@ tty_write(void (*cmdfn)(struct tty *, const struct tty_ctx *),
 {
 	struct window_pane	*wp = ctx->wp;
 	struct client		*c;
+	u_int			 n = 0;
 
 	/* wp can be NULL if updating the screen but not the terminal. */
 	if (wp == NULL)
@@ -785,7 +805,10 @@ tty_write(void (*cmdfn)(struct tty *, const struct tty_ctx *),
 			ctx->yoff++;
 
 		cmdfn(&c->tty, ctx);
+		stats.tty_commands++;
+		n++;
 	}
+	trace_add(TRACE_TTY_COMMAND, wp->id, n, 0);
 }
 
 void
@@ -975,7 +998,7 @@ tty_cmd_linefeed(struct tty *tty, const struct tty_ctx *ctx)
 	    tty_fake_bce(tty, wp, ctx->bg) ||
 	    !tty_term_has(tty->term, TTYC_CSR)) {
 		if (tty_large_region(tty, ctx))
-			wp->flags |= PANE_REDRAW;
+			window_pane_dirty(wp, PANE_REDRAW);
 		else
 			tty_redraw_region(tty, ctx);
 		return;
@@ -1825,20 +1848,12 @@ static void
 tty_default_colours(struct grid_cell *gc, const struct window_pane *wp)
 {
 	struct window		*w = wp->window;
-	struct options		*oo = w->options;
 	const struct grid_cell	*agc, *pgc, *wgc;
 	int			 c;
 
-	if (w->flags & WINDOW_STYLECHANGED) {
-		w->flags &= ~WINDOW_STYLECHANGED;
-		agc = options_get_style(oo, "window-active-style");
-		memcpy(&w->active_style, agc, sizeof w->active_style);
-		wgc = options_get_style(oo, "window-style");
-		memcpy(&w->style, wgc, sizeof w->style);
-	} else {
-		agc = &w->active_style;
-		wgc = &w->style;
-	}
+	window_update_options(w);
+	agc = &w->active_style;
+	wgc = &w->style;
 	pgc = &wp->colgc;
 
 	if (gc->fg == 8) {
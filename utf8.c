@@ -18,14 +18,195 @@
 
 #include <sys/types.h>
 
-#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
 
 #include "tmux.h"
 
-static int	utf8_width(wchar_t);
+/*
+ * Widths of Unicode characters, looked up from wcwidth() (or utf8proc) a
+ * block of 256 at a time the first time any character in the block is seen,
+ * so the width is the same as the system's but each character is only looked
+ * up once. -2 means too wide.
+ */
+#define UTF8_WIDTH_MAX 0x110000
+#define UTF8_WIDTH_BLOCK 256
+static signed char	*utf8_width_table[UTF8_WIDTH_MAX / UTF8_WIDTH_BLOCK];
+
+static signed char	*utf8_width_block(u_int);
+static int		 utf8_width(wchar_t);
+
+/*
+ * Characters stored in the grid are packed into a utf8_char. Up to three
+ * bytes are kept inline with their size and width; anything longer (four
+ * byte characters and grapheme clusters) is interned in a shared pool and
+ * the utf8_char holds its index with a size of UTF8_SIZE_POOL. Pool entries
+ * are never freed, since the same clusters tend to be used over and over.
+ */
+#define UTF8_GET_SIZE(uc) (((uc) >> 24) & 0x7)
+#define UTF8_GET_WIDTH(uc) (((uc) >> 27) & 0x3)
+#define UTF8_SET_SIZE(size) (((utf8_char)(size)) << 24)
+#define UTF8_SET_WIDTH(width) (((utf8_char)(width)) << 27)
+#define UTF8_SIZE_POOL 7
+#define UTF8_INDEX_MAX 0xffffff
+
+struct utf8_item {
+	u_int			index;
+	u_char			data[UTF8_SIZE];
+	u_char			size;
+
+	RB_ENTRY(utf8_item)	entry;
+};
+RB_HEAD(utf8_tree, utf8_item);
+static int	utf8_cmp(struct utf8_item *, struct utf8_item *);
+RB_GENERATE_STATIC(utf8_tree, utf8_item, entry, utf8_cmp);
+static struct utf8_tree utf8_tree = RB_INITIALIZER(utf8_tree);
+
+static struct utf8_item	**utf8_list;
+static u_int		  utf8_list_size;
+static u_int		  utf8_list_used;
+
+/* Compare pool items. */
+static int
+utf8_cmp(struct utf8_item *ui1, struct utf8_item *ui2)
+{
+	if (ui1->size < ui2->size)
+		return (-1);
+	if (ui1->size > ui2->size)
+		return (1);
+	return (memcmp(ui1->data, ui2->data, ui1->size));
+}
+
+/* Find or add data to the pool and return its index. */
+static int
+utf8_intern(const u_char *data, size_t size, u_int *index)
+{
+	struct utf8_item	 find, *ui;
+
+	memcpy(find.data, data, size);
+	find.size = size;
+	if ((ui = RB_FIND(utf8_tree, &utf8_tree, &find)) != NULL) {
+		*index = ui->index;
+		return (0);
+	}
+
+	if (utf8_list_used > UTF8_INDEX_MAX)
+		return (-1);
+	if (utf8_list_used == utf8_list_size) {
+		utf8_list_size = utf8_list_size == 0 ? 64 : utf8_list_size * 2;
+		utf8_list = xreallocarray(utf8_list, utf8_list_size,
+		    sizeof *utf8_list);
+	}
+
+	ui = xcalloc(1, sizeof *ui);
+	ui->index = utf8_list_used;
+	memcpy(ui->data, data, size);
+	ui->size = size;
+	RB_INSERT(utf8_tree, &utf8_tree, ui);
+	utf8_list[utf8_list_used++] = ui;
+
+	log_debug("UTF-8 %.*s interned as %u", (int)size, data, ui->index);
+	*index = ui->index;
+	return (0);
+}
+
+/*
+ * Pack UTF-8 data into a utf8_char. If it can't be stored, an underscore of
+ * the same width is used instead.
+ */
+enum utf8_state
+utf8_from_data(const struct utf8_data *ud, utf8_char *uc)
+{
+	u_int	index;
+
+	if (ud->width > 3)
+		goto fail;
+	if (ud->size <= 3) {
+		*uc = UTF8_SET_SIZE(ud->size)|UTF8_SET_WIDTH(ud->width);
+		switch (ud->size) {
+		case 3:
+			*uc |= (utf8_char)ud->data[2] << 16;
+			/* FALLTHROUGH */
+		case 2:
+			*uc |= (utf8_char)ud->data[1] << 8;
+			/* FALLTHROUGH */
+		case 1:
+			*uc |= ud->data[0];
+		}
+		return (UTF8_DONE);
+	}
+	if (utf8_intern(ud->data, ud->size, &index) != 0)
+		goto fail;
+	*uc = UTF8_SET_SIZE(UTF8_SIZE_POOL)|UTF8_SET_WIDTH(ud->width)|index;
+	return (UTF8_DONE);
+
+fail:
+	*uc = UTF8_SET_SIZE(1)|UTF8_SET_WIDTH(ud->width > 3 ? 1 : ud->width)|'_';
+	return (UTF8_ERROR);
+}
+
+/* Unpack a utf8_char into UTF-8 data. */
+void
+utf8_to_data(utf8_char uc, struct utf8_data *ud)
+{
+	struct utf8_item	*ui;
+	u_int			 index;
+
+	memset(ud, 0, sizeof *ud);
+	ud->width = UTF8_GET_WIDTH(uc);
+
+	ud->size = UTF8_GET_SIZE(uc);
+	if (ud->size != UTF8_SIZE_POOL) {
+		ud->have = ud->size;
+		ud->data[0] = uc & 0xff;
+		ud->data[1] = (uc >> 8) & 0xff;
+		ud->data[2] = (uc >> 16) & 0xff;
+		return;
+	}
+
+	index = uc & UTF8_INDEX_MAX;
+	if (index >= utf8_list_used) {
+		utf8_set(ud, '_');
+		return;
+	}
+	ui = utf8_list[index];
+	memcpy(ud->data, ui->data, ui->size);
+	ud->have = ud->size = ui->size;
+}
+
+/*
+ * Work out if a character continues the grapheme cluster in the previous
+ * cell. This is a subset of the Unicode segmentation rules: zero width
+ * characters (combining marks, variation selectors and the zero width joiner
+ * itself) extend a cluster, anything following a zero width joiner is joined
+ * on and emoji modifiers extend a wide character.
+ */
+int
+utf8_in_cluster(const struct utf8_data *cluster, const struct utf8_data *ud)
+{
+	const u_char	*last;
+
+	if (ud->width == 0)
+		return (1);
+	if (cluster->size == 0)
+		return (0);
+
+	/* Zero width joiner U+200D. */
+	if (cluster->size >= 3) {
+		last = cluster->data + cluster->size - 3;
+		if (last[0] == 0xe2 && last[1] == 0x80 && last[2] == 0x8d)
+			return (1);
+	}
+
+	/* Emoji modifiers U+1F3FB to U+1F3FF. */
+	if (cluster->width == 2 && ud->size == 4 && ud->data[0] == 0xf0 &&
+	    ud->data[1] == 0x9f && ud->data[2] == 0x8f &&
+	    ud->data[3] >= 0xbb && ud->data[3] <= 0xbf)
+		return (1);
+
+	return (0);
+}
 
 /* Set a single character. */
 void
@@ -103,18 +284,49 @@ utf8_append(struct utf8_data *ud, u_char ch)
 	return (UTF8_DONE);
 }
 
-/* Get width of Unicode character. */
-static int
-utf8_width(wchar_t wc)
+/* Fill in the widths for a block of characters. */
+static signed char *
+utf8_width_block(u_int block)
 {
-	int	width;
-
+	signed char	*widths;
+	wchar_t		 wc;
+	u_int		 i;
+	int		 width;
+
+	widths = xmalloc(UTF8_WIDTH_BLOCK);
+	for (i = 0; i < UTF8_WIDTH_BLOCK; i++) {
+		wc = block * UTF8_WIDTH_BLOCK + i;
 #ifdef HAVE_UTF8PROC
-	width = utf8proc_wcwidth(wc);
+		width = utf8proc_wcwidth(wc);
 #else
-	width = wcwidth(wc);
+		width = wcwidth(wc);
 #endif
-	if (width < 0 || width > 0xff) {
+		if (width > 0xff)
+			width = -2;
+		else if (width < 0)
+			width = -1;
+		widths[i] = width;
+	}
+	utf8_width_table[block] = widths;
+	return (widths);
+}
+
+/* Get width of Unicode character. */
+static int
+utf8_width(wchar_t wc)
+{
+	signed char	*widths;
+	int		 width;
+
+	if (wc < 0 || (u_int)wc >= UTF8_WIDTH_MAX)
+		width = -1;
+	else {
+		widths = utf8_width_table[wc / UTF8_WIDTH_BLOCK];
+		if (widths == NULL)
+			widths = utf8_width_block(wc / UTF8_WIDTH_BLOCK);
+		width = widths[wc % UTF8_WIDTH_BLOCK];
+	}
+	if (width < 0) {
 		log_debug("Unicode %04x, wcwidth() %d", wc, width);
 
 #ifndef __OpenBSD__
@@ -127,7 +339,7 @@ utf8_width(wchar_t wc)
 		 * but this is no worse than sending the same to the terminal
 		 * without tmux.
 		 */
-		if (width < 0)
+		if (width == -1)
 			return (1);
 #endif
 		return (-1);
@@ -135,44 +347,84 @@ utf8_width(wchar_t wc)
 	return (width);
 }
 
-/* Combine UTF-8 into Unicode. */
+/*
+ * Combine UTF-8 into Unicode. The locale is always UTF-8 so this is done
+ * directly rather than with mbtowc(3). Overlong forms, surrogates and
+ * characters above U+10FFFF are invalid.
+ */
 enum utf8_state
 utf8_combine(const struct utf8_data *ud, wchar_t *wc)
 {
-#ifdef HAVE_UTF8PROC
-	switch (utf8proc_mbtowc(wc, ud->data, ud->size)) {
-#else
-	switch (mbtowc(wc, ud->data, ud->size)) {
-#endif
-	case -1:
-		log_debug("UTF-8 %.*s, mbtowc() %d", (int)ud->size, ud->data,
-		    errno);
-		mbtowc(NULL, NULL, MB_CUR_MAX);
-		return (UTF8_ERROR);
-	case 0:
-		return (UTF8_ERROR);
+	const u_char	*p = ud->data;
+	u_int		 i, value;
+
+	for (i = 1; i < ud->size; i++) {
+		if ((p[i] & 0xc0) != 0x80)
+			goto invalid;
+	}
+
+	switch (ud->size) {
+	case 1:
+		value = p[0];
+		if (value == 0 || value > 0x7f)
+			goto invalid;
+		break;
+	case 2:
+		value = ((p[0] & 0x1f) << 6) | (p[1] & 0x3f);
+		if (value < 0x80)
+			goto invalid;
+		break;
+	case 3:
+		value = ((p[0] & 0x0f) << 12) | ((p[1] & 0x3f) << 6) |
+		    (p[2] & 0x3f);
+		if (value < 0x800 || (value >= 0xd800 && value <= 0xdfff))
+			goto invalid;
+		break;
+	case 4:
+		value = ((p[0] & 0x07) << 18) | ((p[1] & 0x3f) << 12) |
+		    ((p[2] & 0x3f) << 6) | (p[3] & 0x3f);
+		if (value < 0x10000 || value > 0x10ffff)
+			goto invalid;
+		break;
 	default:
-		return (UTF8_DONE);
+		goto invalid;
 	}
+	*wc = value;
+	return (UTF8_DONE);
+
+invalid:
+	log_debug("UTF-8 %.*s invalid", (int)ud->size, ud->data);
+	return (UTF8_ERROR);
 }
 
 /* Split Unicode into UTF-8. */
 enum utf8_state
 utf8_split(wchar_t wc, struct utf8_data *ud)
 {
-	char	s[MB_LEN_MAX];
-	int	slen;
+	u_char	*p = ud->data;
 
-#ifdef HAVE_UTF8PROC
-	slen = utf8proc_wctomb(s, wc);
-#else
-	slen = wctomb(s, wc);
-#endif
-	if (slen <= 0 || slen > (int)sizeof ud->data)
+	if (wc < 0 || (wc >= 0xd800 && wc <= 0xdfff) || wc > 0x10ffff)
 		return (UTF8_ERROR);
 
-	memcpy(ud->data, s, slen);
-	ud->size = slen;
+	if (wc < 0x80) {
+		p[0] = wc;
+		ud->size = 1;
+	} else if (wc < 0x800) {
+		p[0] = 0xc0 | (wc >> 6);
+		p[1] = 0x80 | (wc & 0x3f);
+		ud->size = 2;
+	} else if (wc < 0x10000) {
+		p[0] = 0xe0 | (wc >> 12);
+		p[1] = 0x80 | ((wc >> 6) & 0x3f);
+		p[2] = 0x80 | (wc & 0x3f);
+		ud->size = 3;
+	} else {
+		p[0] = 0xf0 | (wc >> 18);
+		p[1] = 0x80 | ((wc >> 12) & 0x3f);
+		p[2] = 0x80 | ((wc >> 6) & 0x3f);
+		p[3] = 0x80 | (wc & 0x3f);
+		ud->size = 4;
+	}
 
 	ud->width = utf8_width(wc);
 	return (UTF8_DONE);
@@ -354,6 +606,13 @@ utf8_cstrwidth(const char *s)
 
 	width = 0;
 	while (*s != '\0') {
+		/* Most strings are mostly ASCII, so skip through it quickly. */
+		if ((u_char)*s < 0x80) {
+			if (*s > 0x1f && *s != 0x7f)
+				width++;
+			s++;
+			continue;
+		}
 		if ((more = utf8_open(&tmp, *s)) == UTF8_MORE) {
 			while (*++s != '\0' && more == UTF8_MORE)
 				more = utf8_append(&tmp, *s);
@@ -265,8 +265,9 @@ window_copy_free(struct window_pane *wp)
 {
 	struct window_copy_mode_data	*data = wp->modedata;
 
+	/* Reading is resumed by window_pane_reset_mode once the mode is gone. */
 	if (wp->fd != -1)
-		bufferevent_enable(wp->event, EV_READ|EV_WRITE);
+		bufferevent_enable(wp->event, EV_WRITE);
 
 	free(data->searchmark);
 	free(data->searchstr);
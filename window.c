@@ -18,6 +18,7 @@
 
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 
 #include <errno.h>
 #include <fcntl.h>
@@ -56,6 +57,19 @@ struct windows windows;
 
 /* Global panes tree. */
 struct window_pane_tree all_window_panes;
+
+/* Panes resized but not yet reflowed. */
+static TAILQ_HEAD(, window_pane) window_pane_reflows =
+    TAILQ_HEAD_INITIALIZER(window_pane_reflows);
+
+/* Windows with panes to be checked at the end of the loop. */
+static TAILQ_HEAD(, window) window_dirty_list =
+    TAILQ_HEAD_INITIALIZER(window_dirty_list);
+
+/* Number of process lookups allowed each loop for panes with a cached one. */
+#define WINDOW_PANE_PROCESS_BUDGET 16
+static u_int	window_pane_process_budget = WINDOW_PANE_PROCESS_BUDGET;
+
 static u_int	next_window_pane_id;
 static u_int	next_window_id;
 static u_int	next_active_point;
@@ -67,8 +81,13 @@ static struct window_pane *window_pane_create(struct window *, u_int, u_int,
 static void	window_pane_destroy(struct window_pane *);
 
 static void	window_pane_set_watermark(struct window_pane *, size_t);
+static void	window_pane_process_update(struct window_pane *, int);
 
 static void	window_pane_read_callback(struct bufferevent *, void *);
+static int	window_pane_pipe_open(struct window_pane *);
+static void	window_pane_pipe_rotate(struct window_pane *, size_t);
+static void	window_pane_pipe_write(struct window_pane *, const u_char *,
+		    size_t);
 static void	window_pane_error_callback(struct bufferevent *, short, void *);
 
 static int	winlink_next_index(struct winlinks *, int);
@@ -188,7 +207,7 @@ winlink_set_window(struct winlink *wl, struct window *w)
 {
 	if (wl->window != NULL) {
 		TAILQ_REMOVE(&wl->window->winlinks, wl, wentry);
-		window_remove_ref(w);
+		window_remove_ref(wl->window);
 	}
 	TAILQ_INSERT_TAIL(&w->winlinks, wl, wentry);
 	wl->window = w;
@@ -301,6 +320,31 @@ window_update_activity(struct window *w)
 	alerts_queue(w, WINDOW_ACTIVITY);
 }
 
+/* Update values cached from the window options if any options have changed. */
+void
+window_update_options(struct window *w)
+{
+	struct options	*oo = w->options;
+
+	if (w->options_generation == options_generation)
+		return;
+	w->options_generation = options_generation;
+
+	memcpy(&w->style, options_get_style(oo, "window-style"),
+	    sizeof w->style);
+	memcpy(&w->active_style, options_get_style(oo, "window-active-style"),
+	    sizeof w->active_style);
+	style_apply(&w->border_style, oo, "pane-border-style");
+	style_apply(&w->active_border_style, oo, "pane-active-border-style");
+
+	w->pane_status = options_get_number(oo, "pane-border-status");
+	w->monitor_activity = options_get_number(oo, "monitor-activity");
+	w->monitor_silence = options_get_number(oo, "monitor-silence");
+	w->pipe_limit = options_get_number(oo, "pipe-pane-limit");
+	w->pipe_overflow = options_get_number(oo, "pipe-pane-overflow");
+	w->pipe_rotate = options_get_number(oo, "pipe-pane-rotate");
+}
+
 struct window *
 window_create(u_int sx, u_int sy)
 {
@@ -308,7 +352,7 @@ window_create(u_int sx, u_int sy)
 
 	w = xcalloc(1, sizeof *w);
 	w->name = NULL;
-	w->flags = WINDOW_STYLECHANGED;
+	w->flags = 0;
 
 	TAILQ_INIT(&w->panes);
 	w->active = NULL;
@@ -374,11 +418,11 @@ window_destroy(struct window *w)
 		layout_free_cell(w->saved_layout_root);
 	free(w->old_layout);
 
-	if (event_initialized(&w->name_event))
-		evtimer_del(&w->name_event);
+	timer_del(&w->name_timer);
+	timer_del(&w->alerts_timer);
 
-	if (event_initialized(&w->alerts_timer))
-		evtimer_del(&w->alerts_timer);
+	if (w->dirty_queued)
+		TAILQ_REMOVE(&window_dirty_list, w, dirty_entry);
 
 	options_free(w->options);
 
@@ -440,7 +484,7 @@ window_set_active_pane(struct window *w, struct window_pane *wp)
 			return (1);
 	}
 	w->active->active_point = next_active_point++;
-	w->active->flags |= PANE_CHANGED;
+	window_pane_dirty(w->active, PANE_CHANGED);
 	return (1);
 }
 
@@ -467,11 +511,11 @@ window_redraw_active_switch(struct window *w, struct window_pane *wp)
 	if (window_pane_get_palette(w->active, w->active->colgc.fg) != -1 ||
 	    window_pane_get_palette(w->active, w->active->colgc.bg) != -1 ||
 	    style_equal(&grid_default_cell, &w->active->colgc))
-		w->active->flags |= PANE_REDRAW;
+		window_pane_dirty(w->active, PANE_REDRAW);
 	if (window_pane_get_palette(wp, wp->colgc.fg) != -1 ||
 	    window_pane_get_palette(wp, wp->colgc.bg) != -1 ||
 	    style_equal(&grid_default_cell, &wp->colgc))
-		wp->flags |= PANE_REDRAW;
+		window_pane_dirty(wp, PANE_REDRAW);
 }
 
 struct window_pane *
@@ -611,7 +655,7 @@ window_lost_pane(struct window *w, struct window_pane *wp)
 				w->active = TAILQ_NEXT(wp, entry);
 		}
 		if (w->active != NULL)
-			w->active->flags |= PANE_CHANGED;
+			window_pane_dirty(w->active, PANE_CHANGED);
 	} else if (wp == w->last)
 		w->last = NULL;
 }
@@ -774,6 +818,8 @@ window_pane_create(struct window *w, u_int sx, u_int sy, u_int hlimit)
 	wp->fd = -1;
 	wp->event = NULL;
 
+	wp->process_pgrp = -1;
+
 	wp->mode = NULL;
 	wp->modeprefix = 1;
 
@@ -825,19 +871,21 @@ window_pane_destroy(struct window_pane *wp)
 	if (wp->saved_grid != NULL)
 		grid_destroy(wp->saved_grid);
 
-	if (wp->pipe_fd != -1) {
-		bufferevent_free(wp->pipe_event);
-		close(wp->pipe_fd);
-	}
+	window_pane_pipe_close(wp);
 
 	if (event_initialized(&wp->resize_timer))
 		event_del(&wp->resize_timer);
+	if (wp->flags & PANE_REFLOW)
+		TAILQ_REMOVE(&window_pane_reflows, wp, reflow_entry);
+	server_client_untrack_focus(wp);
 
 	RB_REMOVE(window_pane_tree, &all_window_panes, wp);
 
 	free((void *)wp->cwd);
 	free(wp->shell);
 	cmd_free_argv(wp->argc, wp->argv);
+	free(wp->process_name);
+	free(wp->process_cwd);
 	free(wp->palette);
 	free(wp);
 }
@@ -892,6 +940,17 @@ window_pane_spawn(struct window_pane *wp, int argc, char **argv,
 	ws.ws_col = screen_size_x(&wp->base);
 	ws.ws_row = screen_size_y(&wp->base);
 
+	/* Use the spawn helper if it is running, otherwise fork ourselves. */
+	wp->pid = spawn_helper_pane(wp, path, env, tio, &ws);
+	if (wp->pid == -1) {
+		wp->fd = -1;
+		xasprintf(cause, "%s: %s", cmd, strerror(errno));
+		free(cmd);
+		return (-1);
+	}
+	if (wp->pid != 0)
+		goto spawned;
+
 	switch (wp->pid = forkpty(&wp->fd, wp->tty, NULL, &ws)) {
 	case -1:
 		wp->fd = -1;
@@ -957,6 +1016,7 @@ window_pane_spawn(struct window_pane *wp, int argc, char **argv,
 		fatal("execl failed");
 	}
 
+spawned:
 #ifdef HAVE_UTEMPTER
 	xsnprintf(s, sizeof s, "tmux(%lu).%%%u", (long) getpid(), wp->id);
 	utempter_add_record(wp->fd, s);
@@ -983,7 +1043,10 @@ window_pane_read_callback(__unused struct bufferevent *bufev, void *data)
 	size_t			 size = EVBUFFER_LENGTH(evb);
 	char			*new_data;
 	size_t			 new_size;
+	struct timeval		 start;
+	unsigned long long	 us;
 
+	gettimeofday(&start, NULL);
 	if (wp->wmark_size == READ_FAST_SIZE) {
 		if (size > READ_FULL_SIZE)
 			wp->wmark_hits++;
@@ -998,15 +1061,195 @@ window_pane_read_callback(__unused struct bufferevent *bufev, void *data)
 	log_debug("%%%u has %zu bytes (of %u, %u hits)", wp->id, size,
 	    wp->wmark_size, wp->wmark_hits);
 
+	wp->bytes_read += size - wp->pipe_off;
+	stats.pane_bytes += size - wp->pipe_off;
+
 	new_size = size - wp->pipe_off;
 	if (wp->pipe_fd != -1 && new_size > 0) {
 		new_data = EVBUFFER_DATA(evb) + wp->pipe_off;
-		bufferevent_write(wp->pipe_event, new_data, new_size);
+		window_pane_pipe_write(wp, new_data, new_size);
 	}
 
 	input_parse(wp);
 
 	wp->pipe_off = EVBUFFER_LENGTH(evb);
+
+	if ((us = stats_time(STATS_PANE_READ, &start)) != 0) {
+		stats_slow(STATS_PANE_READ, us, "pane %%%u (%zu bytes)",
+		    wp->id, size);
+	}
+}
+
+/* Open the file for a pane piped to a file. */
+static int
+window_pane_pipe_open(struct window_pane *wp)
+{
+	struct stat	sb;
+	int		fd;
+
+	fd = open(wp->pipe_path, O_WRONLY|O_APPEND|O_CREAT, 0600);
+	if (fd == -1)
+		return (-1);
+	if (fstat(fd, &sb) != 0) {
+		close(fd);
+		return (-1);
+	}
+	wp->pipe_fd = fd;
+	wp->pipe_size = sb.st_size;
+	return (0);
+}
+
+/* Pipe pane output directly to a file. */
+int
+window_pane_pipe_file(struct window_pane *wp, const char *path)
+{
+	wp->pipe_path = xstrdup(path);
+	if (window_pane_pipe_open(wp) != 0) {
+		free(wp->pipe_path);
+		wp->pipe_path = NULL;
+		return (-1);
+	}
+	wp->pipe_off = EVBUFFER_LENGTH(wp->event->input);
+	return (0);
+}
+
+/* Close pane pipe, if any. */
+void
+window_pane_pipe_close(struct window_pane *wp)
+{
+	if (wp->pipe_fd == -1)
+		return;
+
+	if (wp->pipe_event != NULL) {
+		bufferevent_free(wp->pipe_event);
+		wp->pipe_event = NULL;
+	}
+	close(wp->pipe_fd);
+	wp->pipe_fd = -1;
+
+	free(wp->pipe_path);
+	wp->pipe_path = NULL;
+
+	window_pane_pipe_unblock(wp);
+}
+
+/* Start reading from the pane again once its pipe has caught up. */
+void
+window_pane_pipe_unblock(struct window_pane *wp)
+{
+	if (~wp->flags & PANE_PIPEFULL)
+		return;
+	wp->flags &= ~PANE_PIPEFULL;
+
+	log_debug("%%%u pipe no longer full", wp->id);
+	window_pane_read_resume(wp);
+}
+
+/* Start reading from the pane again, unless something else has stopped it. */
+void
+window_pane_read_resume(struct window_pane *wp)
+{
+	if (wp->fd == -1 || (wp->flags & PANE_PIPEFULL) || wp->captures != 0)
+		return;
+	if (wp->mode == &window_copy_mode)
+		return;
+	bufferevent_enable(wp->event, EV_READ);
+}
+
+/* Start a new file if the pipe file would grow too big. */
+static void
+window_pane_pipe_rotate(struct window_pane *wp, size_t size)
+{
+	u_int	 limit = wp->window->pipe_rotate;
+	char	*path;
+
+	if (limit == 0 || wp->pipe_size == 0)
+		return;
+	if (wp->pipe_size + (off_t)size <= (off_t)limit)
+		return;
+
+	close(wp->pipe_fd);
+	wp->pipe_fd = -1;
+
+	xasprintf(&path, "%s.1", wp->pipe_path);
+	if (rename(wp->pipe_path, path) != 0)
+		log_debug("%%%u rename %s failed", wp->id, wp->pipe_path);
+	free(path);
+
+	if (window_pane_pipe_open(wp) != 0) {
+		log_debug("%%%u open %s failed", wp->id, wp->pipe_path);
+		free(wp->pipe_path);
+		wp->pipe_path = NULL;
+	}
+}
+
+/*
+ * Write pane output to the pipe. Data is written straight to the file
+ * descriptor if nothing is waiting and only what is left over is buffered, up
+ * to the pipe-pane-limit option.
+ */
+static void
+window_pane_pipe_write(struct window_pane *wp, const u_char *data,
+    size_t size)
+{
+	struct window	*w = wp->window;
+	struct evbuffer	*evb;
+	ssize_t		 n;
+	size_t		 used, space;
+
+	window_update_options(w);
+
+	if (wp->pipe_event == NULL) {
+		window_pane_pipe_rotate(wp, size);
+		if (wp->pipe_fd == -1)
+			n = 0;
+		else if ((n = write(wp->pipe_fd, data, size)) == -1)
+			n = 0;
+		else
+			wp->pipe_size += n;
+		wp->pipe_bytes += n;
+		stats.pipe_bytes += n;
+		wp->pipe_dropped += size - n;
+		stats.pipe_dropped += size - n;
+		return;
+	}
+
+	evb = wp->pipe_event->output;
+	if (EVBUFFER_LENGTH(evb) == 0) {
+		n = write(wp->pipe_fd, data, size);
+		if (n > 0) {
+			data += n;
+			size -= n;
+			wp->pipe_bytes += n;
+			stats.pipe_bytes += n;
+		}
+	}
+	if (size == 0)
+		return;
+
+	used = EVBUFFER_LENGTH(evb);
+	if (w->pipe_limit != 0 && used + size > w->pipe_limit) {
+		if (w->pipe_overflow == PIPE_OVERFLOW_BLOCK) {
+			if (~wp->flags & PANE_PIPEFULL) {
+				log_debug("%%%u pipe full", wp->id);
+				wp->flags |= PANE_PIPEFULL;
+				bufferevent_disable(wp->event, EV_READ);
+			}
+		} else {
+			if (used < w->pipe_limit)
+				space = w->pipe_limit - used;
+			else
+				space = 0;
+			wp->pipe_dropped += size - space;
+			stats.pipe_dropped += size - space;
+			size = space;
+		}
+	}
+	if (size != 0) {
+		bufferevent_write(wp->pipe_event, data, size);
+		wp->pipe_bytes += size;
+		stats.pipe_bytes += size;
+	}
 }
 
 static void
@@ -1026,11 +1269,163 @@ window_pane_resize(struct window_pane *wp, u_int sx, u_int sy)
 	wp->sx = sx;
 	wp->sy = sy;
 
-	screen_resize(&wp->base, sx, sy, wp->saved_grid == NULL);
-	if (wp->mode != NULL)
+	/*
+	 * Reflowing the history is expensive and a pane may be resized many
+	 * times while dragging a border or resizing the terminal, so it is put
+	 * off until the end of the loop and done once at the final size. Modes
+	 * keep positions in the history, so if there is one, reflow now before
+	 * it is told about the new size.
+	 */
+	screen_resize(&wp->base, sx, sy, 0);
+	if (wp->saved_grid == NULL && (~wp->flags & PANE_REFLOW)) {
+		wp->flags |= PANE_REFLOW;
+		TAILQ_INSERT_TAIL(&window_pane_reflows, wp, reflow_entry);
+	}
+	if (wp->mode != NULL) {
+		window_pane_reflow(wp);
 		wp->mode->resize(wp, sx, sy);
+	}
+
+	window_pane_dirty(wp, PANE_RESIZE);
+}
+
+/* Reflow a pane if it has been resized. */
+void
+window_pane_reflow(struct window_pane *wp)
+{
+	if (~wp->flags & PANE_REFLOW)
+		return;
+	wp->flags &= ~PANE_REFLOW;
+	TAILQ_REMOVE(&window_pane_reflows, wp, reflow_entry);
 
-	wp->flags |= PANE_RESIZE;
+	screen_resize(&wp->base, wp->sx, wp->sy, 1);
+}
+
+/* Reflow all panes that have been resized. */
+void
+window_pane_reflow_all(void)
+{
+	struct window_pane	*wp;
+
+	while ((wp = TAILQ_FIRST(&window_pane_reflows)) != NULL)
+		window_pane_reflow(wp);
+}
+
+/* Reset the process lookup budget at the start of each loop. */
+void
+window_pane_process_reset(void)
+{
+	window_pane_process_budget = WINDOW_PANE_PROCESS_BUDGET;
+}
+
+/*
+ * Look up the name and working directory of the foreground process in a pane.
+ * These come from the system (/proc on Linux) and are needed for every pane
+ * whenever automatic-rename or the status line is updated, so they are cached
+ * against the foreground process group. They are looked up again immediately
+ * when the process group changes and otherwise when older than process-time,
+ * but the latter only while this loop's budget lasts. If process-time is zero
+ * or the caller needs them to be current (a command rather than the status
+ * line), there is no caching and they are always looked up.
+ */
+static void
+window_pane_process_update(struct window_pane *wp, int force)
+{
+	struct timeval	now, tv;
+	pid_t		pgrp;
+	u_int		ms;
+	char		*cwd;
+
+	if (wp->fd == -1) {
+		free(wp->process_name);
+		wp->process_name = NULL;
+		free(wp->process_cwd);
+		wp->process_cwd = NULL;
+		wp->process_pgrp = -1;
+		return;
+	}
+	pgrp = tcgetpgrp(wp->fd);
+
+	gettimeofday(&now, NULL);
+	ms = options_get_number(global_options, "process-time");
+	if (pgrp == wp->process_pgrp && ms != 0 && !force) {
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = (ms % 1000) * 1000L;
+		timeradd(&wp->process_time, &tv, &tv);
+		if (timercmp(&now, &tv, <))
+			return;
+		if (window_pane_process_budget == 0)
+			return;
+	}
+	if (window_pane_process_budget != 0)
+		window_pane_process_budget--;
+
+	free(wp->process_name);
+	wp->process_name = osdep_get_name(wp->fd, wp->tty);
+
+	free(wp->process_cwd);
+	if ((cwd = osdep_get_cwd(wp->fd)) != NULL)
+		wp->process_cwd = xstrdup(cwd);
+	else
+		wp->process_cwd = NULL;
+
+	log_debug("%s: %%%u pgrp %ld is %s (%s)", __func__, wp->id, (long)pgrp,
+	    wp->process_name == NULL ? "unknown" : wp->process_name,
+	    wp->process_cwd == NULL ? "unknown" : wp->process_cwd);
+
+	wp->process_pgrp = pgrp;
+	wp->process_time = now;
+}
+
+/* Get name of the foreground process in a pane. */
+const char *
+window_pane_process_name(struct window_pane *wp, int force)
+{
+	window_pane_process_update(wp, force);
+	return (wp->process_name);
+}
+
+/* Get working directory of the foreground process in a pane. */
+const char *
+window_pane_process_cwd(struct window_pane *wp, int force)
+{
+	window_pane_process_update(wp, force);
+	return (wp->process_cwd);
+}
+
+/*
+ * Set window flags and queue it to be checked at the end of the loop. Only
+ * queued windows have their panes checked for redraw, resize and so on.
+ */
+void
+window_dirty(struct window *w, int flags)
+{
+	w->flags |= flags;
+	if (!w->dirty_queued) {
+		w->dirty_queued = 1;
+		TAILQ_INSERT_TAIL(&window_dirty_list, w, dirty_entry);
+	}
+}
+
+/* Set pane flags and queue its window. */
+void
+window_pane_dirty(struct window_pane *wp, int flags)
+{
+	wp->flags |= flags;
+	window_dirty(wp->window, 0);
+}
+
+/* Remove and return the next queued window. */
+struct window *
+window_next_dirty(void)
+{
+	struct window	*w;
+
+	if ((w = TAILQ_FIRST(&window_dirty_list)) != NULL) {
+		TAILQ_REMOVE(&window_dirty_list, w, dirty_entry);
+		w->dirty_queued = 0;
+	}
+	return (w);
 }
 
 /*
@@ -1048,6 +1443,7 @@ window_pane_alternate_on(struct window_pane *wp, struct grid_cell *gc,
 		return;
 	if (!options_get_number(wp->window->options, "alternate-screen"))
 		return;
+	window_pane_reflow(wp);
 	sx = screen_size_x(s);
 	sy = screen_size_y(s);
 
@@ -1063,7 +1459,7 @@ window_pane_alternate_on(struct window_pane *wp, struct grid_cell *gc,
 
 	wp->base.grid->flags &= ~GRID_HISTORY;
 
-	wp->flags |= PANE_REDRAW;
+	window_pane_dirty(wp, PANE_REDRAW);
 }
 
 /* Exit alternate screen mode and restore the copied grid. */
@@ -1111,7 +1507,7 @@ window_pane_alternate_off(struct window_pane *wp, struct grid_cell *gc,
 	grid_destroy(wp->saved_grid);
 	wp->saved_grid = NULL;
 
-	wp->flags |= PANE_REDRAW;
+	window_pane_dirty(wp, PANE_REDRAW);
 }
 
 void
@@ -1124,7 +1520,7 @@ window_pane_set_palette(struct window_pane *wp, u_int n, int colour)
 		wp->palette = xcalloc(0x100, sizeof *wp->palette);
 
 	wp->palette[n] = colour;
-	wp->flags |= PANE_REDRAW;
+	window_pane_dirty(wp, PANE_REDRAW);
 }
 
 void
@@ -1134,7 +1530,7 @@ window_pane_unset_palette(struct window_pane *wp, u_int n)
 		return;
 
 	wp->palette[n] = 0;
-	wp->flags |= PANE_REDRAW;
+	window_pane_dirty(wp, PANE_REDRAW);
 }
 
 void
@@ -1145,7 +1541,7 @@ window_pane_reset_palette(struct window_pane *wp)
 
 	free(wp->palette);
 	wp->palette = NULL;
-	wp->flags |= PANE_REDRAW;
+	window_pane_dirty(wp, PANE_REDRAW);
 }
 
 int
@@ -1200,9 +1596,10 @@ window_pane_set_mode(struct window_pane *wp, const struct window_mode *mode)
 	evtimer_set(&wp->modetimer, window_pane_mode_timer, wp);
 	evtimer_add(&wp->modetimer, &tv);
 
+	window_pane_reflow(wp);
 	if ((s = wp->mode->init(wp)) != NULL)
 		wp->screen = s;
-	wp->flags |= (PANE_REDRAW|PANE_CHANGED);
+	window_pane_dirty(wp, PANE_REDRAW|PANE_CHANGED);
 
 	server_status_window(wp->window);
 	return (0);
@@ -1219,9 +1616,10 @@ window_pane_reset_mode(struct window_pane *wp)
 	wp->mode->free(wp);
 	wp->mode = NULL;
 	wp->modeprefix = 1;
+	window_pane_read_resume(wp);
 
 	wp->screen = &wp->base;
-	wp->flags |= (PANE_REDRAW|PANE_CHANGED);
+	window_pane_dirty(wp, PANE_REDRAW|PANE_CHANGED);
 
 	server_status_window(wp->window);
 }
@@ -23,11 +23,15 @@
 
 #include "tmux.h"
 
+/* Number of allocations made, for benchmarking. */
+unsigned long long xmalloc_count;
+
 void *
 xmalloc(size_t size)
 {
 	void *ptr;
 
+	xmalloc_count++;
 	if (size == 0)
 		fatalx("xmalloc: zero size");
 	ptr = malloc(size);
@@ -42,6 +46,7 @@ xcalloc(size_t nmemb, size_t size)
 {
 	void *ptr;
 
+	xmalloc_count++;
 	if (size == 0 || nmemb == 0)
 		fatalx("xcalloc: zero size");
 	ptr = calloc(nmemb, size);
@@ -62,6 +67,7 @@ xreallocarray(void *ptr, size_t nmemb, size_t size)
 {
 	void *new_ptr;
 
+	xmalloc_count++;
 	if (nmemb == 0 || size == 0)
 		fatalx("xreallocarray: zero size");
 	new_ptr = reallocarray(ptr, nmemb, size);
@@ -76,6 +82,7 @@ xstrdup(const char *str)
 {
 	char *cp;
 
+	xmalloc_count++;
 	if ((cp = strdup(str)) == NULL)
 		fatalx("xstrdup: %s", strerror(errno));
 	return cp;
@@ -86,6 +93,7 @@ xstrndup(const char *str, size_t maxlen)
 {
 	char *cp;
 
+	xmalloc_count++;
 	if ((cp = strndup(str, maxlen)) == NULL)
 		fatalx("xstrndup: %s", strerror(errno));
 	return cp;
@@ -109,6 +117,7 @@ xvasprintf(char **ret, const char *fmt, va_list ap)
 {
 	int i;
 
+	xmalloc_count++;
 	i = vasprintf(ret, fmt, ap);
 
 	if (i < 0 || *ret == NULL)
@@ -145,3 +154,169 @@ xvsnprintf(char *str, size_t len, const char *fmt, va_list ap)
 
 	return i;
 }
+
+/*
+ * Arenas. Memory is handed out from large chunks and only given back when the
+ * whole arena is freed, for the many small allocations which all live exactly
+ * as long as something else (a format tree or a command queue item).
+ */
+
+#define ARENA_SIZE 4096
+#define ARENA_MAXIMUM 65536
+#define ARENA_ALIGN(n) (((n) + 15) & ~(size_t)15)
+
+struct arena_chunk {
+	struct arena_chunk	*next;
+};
+
+struct arena {
+	struct arena_chunk	*chunks;
+
+	char			*ptr;
+	char			*end;
+	size_t			 size;
+};
+
+static void	arena_grow(struct arena *, size_t);
+
+/*
+ * Create an arena. The first chunk (of size bytes, or a default if zero) is
+ * allocated with the arena itself.
+ */
+struct arena *
+arena_create(size_t size)
+{
+	struct arena *a;
+
+	if (size == 0)
+		size = ARENA_SIZE;
+	size = ARENA_ALIGN(size);
+
+	a = xmalloc(ARENA_ALIGN(sizeof *a) + size);
+	a->chunks = NULL;
+
+	a->ptr = (char *)a + ARENA_ALIGN(sizeof *a);
+	a->end = a->ptr + size;
+	a->size = size;
+
+	return a;
+}
+
+/* Free an arena and everything allocated from it. */
+void
+arena_free(struct arena *a)
+{
+	struct arena_chunk *chunk, *next;
+
+	for (chunk = a->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	free(a);
+}
+
+/* Start a new chunk with room for at least size bytes. */
+static void
+arena_grow(struct arena *a, size_t size)
+{
+	struct arena_chunk *chunk;
+
+	if (a->size < ARENA_MAXIMUM)
+		a->size *= 2;
+	if (size < a->size)
+		size = a->size;
+
+	chunk = xmalloc(ARENA_ALIGN(sizeof *chunk) + size);
+	chunk->next = a->chunks;
+	a->chunks = chunk;
+
+	a->ptr = (char *)chunk + ARENA_ALIGN(sizeof *chunk);
+	a->end = a->ptr + size;
+}
+
+void *
+arena_malloc(struct arena *a, size_t size)
+{
+	void *ptr;
+
+	if (size == 0)
+		fatalx("arena_malloc: zero size");
+	if (size > SIZE_MAX - 15)
+		fatalx("arena_malloc: allocating %zu bytes", size);
+	size = ARENA_ALIGN(size);
+
+	if (size > (size_t)(a->end - a->ptr))
+		arena_grow(a, size);
+	ptr = a->ptr;
+	a->ptr += size;
+	return ptr;
+}
+
+void *
+arena_calloc(struct arena *a, size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	if (size == 0 || nmemb == 0)
+		fatalx("arena_calloc: zero size");
+	if (SIZE_MAX / nmemb < size)
+		fatalx("arena_calloc: allocating %zu * %zu bytes", nmemb, size);
+
+	ptr = arena_malloc(a, nmemb * size);
+	memset(ptr, 0, nmemb * size);
+	return ptr;
+}
+
+char *
+arena_strdup(struct arena *a, const char *str)
+{
+	size_t size;
+	char *cp;
+
+	size = strlen(str) + 1;
+	cp = arena_malloc(a, size);
+	memcpy(cp, str, size);
+	return cp;
+}
+
+int
+arena_asprintf(struct arena *a, char **ret, const char *fmt, ...)
+{
+	va_list ap;
+	int i;
+
+	va_start(ap, fmt);
+	i = arena_vasprintf(a, ret, fmt, ap);
+	va_end(ap);
+
+	return i;
+}
+
+int
+arena_vasprintf(struct arena *a, char **ret, const char *fmt, va_list ap)
+{
+	va_list aq;
+	size_t left;
+	int i;
+
+	/* Try to print straight into the current chunk. */
+	left = a->end - a->ptr;
+	va_copy(aq, ap);
+	i = vsnprintf(a->ptr, left, fmt, aq);
+	va_end(aq);
+	if (i < 0)
+		fatalx("arena_asprintf: %s", strerror(errno));
+
+	if ((size_t)i < left) {
+		*ret = a->ptr;
+		a->ptr += ARENA_ALIGN((size_t)i + 1);
+		if (a->ptr > a->end)
+			a->ptr = a->end;
+		return i;
+	}
+
+	*ret = arena_malloc(a, (size_t)i + 1);
+	if (vsnprintf(*ret, (size_t)i + 1, fmt, ap) != i)
+		fatalx("arena_asprintf: %s", strerror(errno));
+	return i;
+}
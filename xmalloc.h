@@ -23,6 +23,8 @@
 #define __bounded__(x, y, z)
 #endif
 
+extern unsigned long long xmalloc_count;
+
 void	*xmalloc(size_t);
 void	*xcalloc(size_t, size_t);
 void	*xrealloc(void *, size_t);
@@ -42,4 +44,17 @@ int	 xvsnprintf(char *, size_t, const char *, va_list)
 		__attribute__((__nonnull__ (3)))
 		__attribute__((__bounded__ (__string__, 1, 2)));
 
+struct arena;
+
+struct arena *arena_create(size_t);
+void	 arena_free(struct arena *);
+void	*arena_malloc(struct arena *, size_t);
+void	*arena_calloc(struct arena *, size_t, size_t);
+char	*arena_strdup(struct arena *, const char *);
+int	 arena_asprintf(struct arena *, char **, const char *, ...)
+		__attribute__((__format__ (printf, 3, 4)))
+		__attribute__((__nonnull__ (3)));
+int	 arena_vasprintf(struct arena *, char **, const char *, va_list)
+		__attribute__((__nonnull__ (3)));
+
 #endif	/* XMALLOC_H */